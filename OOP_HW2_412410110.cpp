@@ -1,11 +1,33 @@
 #include <iostream>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <queue>
 #include <utility>
 #include <climits>
+#include <cmath>
 #include <functional>
 #include <iomanip>
 #include <stack>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <typeindex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 using namespace std;
 
@@ -30,1920 +52,6882 @@ const uint BROCAST_ID = UINT_MAX;
 
 // BROCAST_ID means that all neighbors are receivers; UINT_MAX is the maximum value of uint
 
-class header
+// snapshot_writer and snapshot_reader are used to checkpoint the simulation into a binary file
+// every field is stored in native byte order without padding, so the file can be mmapped and read in place
+class snapshot_writer
 {
+    string buf;
+
 public:
-    virtual ~header() {}
+    template <typename T>
+    void put(const T &v) { buf.append(reinterpret_cast<const char *>(&v), sizeof(T)); }
+    void put_str(const string &s)
+    {
+        put<uint>(s.size());
+        buf.append(s);
+    }
+    template <typename T>
+    void put_array(const vector<T> &v) { buf.append(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T)); }
+    // write the whole buffer to a temporary file first so that a crash never leaves a half-written snapshot
+    bool write_to(const string &path) const
+    {
+        string tmp = path + ".tmp";
+        FILE *fp = fopen(tmp.c_str(), "wb");
+        if (fp == nullptr)
+            return false;
+        bool ok = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+        ok = (fclose(fp) == 0) && ok;
+        return ok && rename(tmp.c_str(), path.c_str()) == 0;
+    }
+};
 
-    SET(setSrcID, uint, srcID, _srcID);
-    SET(setDstID, uint, dstID, _dstID);
-    SET(setPreID, uint, preID, _preID);
-    SET(setNexID, uint, nexID, _nexID);
-    GET(getSrcID, uint, srcID);
-    GET(getDstID, uint, dstID);
-    GET(getPreID, uint, preID);
-    GET(getNexID, uint, nexID);
+class snapshot_reader
+{
+    void *base = nullptr;
+    size_t len = 0;
+    const char *cur = nullptr;
+    const char *end = nullptr;
+    bool good = false;
 
-    virtual string type() = 0;
+    snapshot_reader(snapshot_reader &) {}
 
-    // factory concept: generate a header
-    class header_generator
+public:
+    snapshot_reader() {}
+    ~snapshot_reader()
     {
-        // lock the copy constructor
-        header_generator(header_generator &) {}
-        // store all possible types of header
-        static map<string, header_generator *> prototypes;
-
-    protected:
-        // allow derived class to use it
-        header_generator() {}
-        // after you create a new header type, please register the factory of this header type by this function
-        void register_header_type(header_generator *h) { prototypes[h->type()] = h; }
-        // you have to implement your own generate() to generate your header
-        virtual header *generate() = 0;
+        if (base != nullptr)
+            munmap(base, len);
+    }
 
-    public:
-        // you have to implement your own type() to return your header type
-        virtual string type() = 0;
-        // this function is used to generate any type of header derived
-        static header *generate(string type)
+    // map the file read-only; the fd can be closed right away because the mapping keeps the pages alive
+    bool open(const string &path)
+    {
+        FILE *fp = fopen(path.c_str(), "rb");
+        if (fp == nullptr)
+            return false;
+        struct stat st;
+        if (fstat(fileno(fp), &st) != 0 || st.st_size == 0)
         {
-            if (prototypes.find(type) != prototypes.end())
-            {                                        // if this type derived exists
-                return prototypes[type]->generate(); // generate it!!
-            }
-            std::cerr << "no such header type" << std::endl; // otherwise
-            return nullptr;
+            fclose(fp);
+            return false;
         }
-        static void print()
+        len = st.st_size;
+        base = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+        fclose(fp);
+        if (base == MAP_FAILED)
         {
-            cout << "registered header types: " << endl;
-            for (map<string, header::header_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
-                cout << it->second->type() << endl;
+            base = nullptr;
+            return false;
         }
-        virtual ~header_generator() {};
-    };
+        cur = static_cast<const char *>(base);
+        end = cur + len;
+        good = true;
+        return true;
+    }
 
-protected:
-    header() : srcID(BROCAST_ID), dstID(BROCAST_ID), preID(BROCAST_ID), nexID(BROCAST_ID) {} // this constructor cannot be directly called by users
+    template <typename T>
+    T get()
+    {
+        T v{};
+        if (!good || (size_t)(end - cur) < sizeof(T))
+        {
+            good = false;
+            return v;
+        }
+        memcpy(&v, cur, sizeof(T));
+        cur += sizeof(T);
+        return v;
+    }
+    string get_str()
+    {
+        uint n = get<uint>();
+        if (!good || (size_t)(end - cur) < n)
+        {
+            good = false;
+            return "";
+        }
+        string s(cur, n);
+        cur += n;
+        return s;
+    }
+    // n elements copied in one go
+    template <typename T>
+    void get_array(vector<T> &v, size_t n)
+    {
+        v.clear();
+        if (!good || (size_t)(end - cur) / sizeof(T) < n)
+        {
+            good = false;
+            return;
+        }
+        v.resize(n);
+        memcpy(v.data(), cur, n * sizeof(T));
+        cur += n * sizeof(T);
+    }
+    GET(ok, bool, good);
 
-private:
-    uint srcID;
-    uint dstID;
-    uint preID;
-    uint nexID;
-    header(header &) {} // this constructor cannot be directly called by users
+    static bool exists(const string &path)
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0;
+    }
 };
-map<string, header::header_generator *> header::header_generator::prototypes;
 
-class TRA_data_header : public header
+// input_scanner parses the whitespace-separated numbers of the input like cin >> does; a regular file on stdin is
+// mapped instead of read, and anything else (a pipe, a terminal) is read into a buffer first
+// a failed read sets the value to 0 and fails every later read, as with cin
+class input_scanner
 {
-    TRA_data_header(TRA_data_header &s) : labels(s.labels) {} // cannot be called by users
+    void *mapped = nullptr;
+    size_t mapped_len = 0;
+    string buffered;
+    const char *begin = nullptr;
+    const char *cur = nullptr;
+    const char *end = nullptr;
+    bool good = true;
 
-    uint used_labels = 0;
-    stack<uint> labels; // you can use the stack to store labels
-    map<uint, bool> hi;
+    input_scanner(input_scanner &) {}
 
-protected:
-    TRA_data_header() {} // this constructor cannot be directly called by users
+    void skip_space()
+    {
+        while (cur < end && (*cur == ' ' || *cur == '\n' || *cur == '\t' || *cur == '\r' || *cur == '\v' || *cur == '\f'))
+            cur++;
+    }
+    static bool is_digit(char c) { return c >= '0' && c <= '9'; }
 
 public:
-    ~TRA_data_header() {}
-    string type() { return "TRA_data_header"; }
+    input_scanner() {}
+    ~input_scanner()
+    {
+        if (mapped != nullptr)
+            munmap(mapped, mapped_len);
+    }
 
-    void push_label(uint _id)
+    // the input starts at the current position of fp; fp can be closed afterwards
+    void open(FILE *fp)
     {
-        if (_id == getSrcID() || _id == get_label() || getNexID() == get_label())
-            used_labels += 1;
-        else
-            used_labels += 2;
-        labels.push(_id);
+        struct stat st;
+        long offset = ftell(fp);
+        if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && offset >= 0 && offset < st.st_size)
+        {
+            mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+            if (mapped != MAP_FAILED)
+            {
+                mapped_len = st.st_size;
+                madvise(mapped, mapped_len, MADV_SEQUENTIAL);
+                begin = cur = static_cast<const char *>(mapped) + offset;
+                end = static_cast<const char *>(mapped) + mapped_len;
+                return;
+            }
+            mapped = nullptr;
+        }
+        char chunk[1 << 16];
+        for (size_t n; (n = fread(chunk, 1, sizeof(chunk), fp)) > 0;)
+            buffered.append(chunk, n);
+        begin = cur = buffered.data();
+        end = cur + buffered.size();
+    }
+    void open_stdin() { open(stdin); }
+    bool open(const string &path)
+    {
+        FILE *fp = fopen(path.c_str(), "rb");
+        if (fp == nullptr)
+            return false;
+        open(fp);
+        fclose(fp);
+        return true;
+    }
+
+    // the offset of the next read in the input; seek() also clears a failure
+    size_t tell() const { return cur - begin; }
+    void seek(size_t pos)
+    {
+        cur = begin + min(pos, size());
+        good = true;
+    }
+    bool at_end()
+    {
+        skip_space();
+        return cur == end;
     }
-    void pop_label() { labels.pop(); }
-    uint get_num_labels() { return labels.size(); } // although the original returned value's type size_t, we change it for simplicity
-    uint get_label() { return labels.size() ? labels.top() : 0; }
-    uint get_used_labels() { return used_labels; }
 
-    void visit(uint node_id) { hi.insert({node_id, true}); }
-    bool visited(uint node_id) { return !(hi.find(node_id) == hi.end()); }
+    // the whole input, e.g., to fingerprint it
+    const char *data() const { return begin; }
+    size_t size() const { return end - begin; }
 
-    class TRA_data_header_generator;
-    friend class TRA_data_header_generator;
-    // TRA_data_header_generator is derived from header_generator to generate a header
-    class TRA_data_header_generator : public header_generator
+    input_scanner &operator>>(uint &v)
     {
-        static TRA_data_header_generator sample;
-        // this constructor is only for sample to register this header type
-        TRA_data_header_generator() { /*cout << "TRA_data_header registered" << endl;*/ register_header_type(&sample); }
+        v = 0;
+        skip_space();
+        bool negative = false;
+        if (good && cur < end && (*cur == '+' || *cur == '-'))
+            negative = (*cur++ == '-');
+        if (!good || cur == end || !is_digit(*cur))
+        {
+            good = false;
+            return *this;
+        }
+        unsigned long long x = 0;
+        for (; cur < end && is_digit(*cur); cur++)
+        {
+            x = x * 10 + (*cur - '0');
+            if (x > UINT_MAX)
+            {
+                // out of range: cin gives the maximum and fails
+                while (cur < end && is_digit(*cur))
+                    cur++;
+                v = UINT_MAX;
+                good = false;
+                return *this;
+            }
+        }
+        v = negative ? uint(0) - uint(x) : uint(x);
+        return *this;
+    }
 
-    protected:
-        virtual header *generate()
+    input_scanner &operator>>(double &v)
+    {
+        static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        v = 0;
+        skip_space();
+        if (!good || cur == end)
         {
-            // cout << "TRA_data_header generated" << endl;
-            return new TRA_data_header;
+            good = false;
+            return *this;
+        }
+        // [sign] digits [. digits] [e [sign] digits]
+        const char *token = cur;
+        const char *p = cur;
+        bool negative = false;
+        if (*p == '+' || *p == '-')
+            negative = (*p++ == '-');
+        unsigned long long mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool any = false;
+        for (; p < end && is_digit(*p); p++, any = true)
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += (mantissa != 0);
+            }
+            else
+                exponent++;
+        if (p < end && *p == '.')
+            for (p++; p < end && is_digit(*p); p++, any = true)
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += (mantissa != 0);
+                    exponent--;
+                }
+        if (!any)
+        {
+            good = false;
+            return *this;
+        }
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char *q = p + 1;
+            bool exp_negative = false;
+            if (q < end && (*q == '+' || *q == '-'))
+                exp_negative = (*q++ == '-');
+            if (q < end && is_digit(*q))
+            {
+                int e = 0;
+                for (; q < end && is_digit(*q); q++)
+                    e = min(e * 10 + (*q - '0'), 100000);
+                exponent += exp_negative ? -e : e;
+                p = q;
+            }
         }
+        cur = p;
 
-    public:
-        virtual string type() { return "TRA_data_header"; }
-        ~TRA_data_header_generator() {}
-    };
+        // Clinger's fast path: both the mantissa and the power of ten are exact doubles, so one
+        // multiplication or division rounds correctly; the other numbers go through strtod
+        if (digits < 19 && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+        {
+            double x = double(mantissa);
+            x = (exponent >= 0) ? x * pow10[exponent] : x / pow10[-exponent];
+            v = negative ? -x : x;
+            return *this;
+        }
+        string copy(token, p);
+        v = strtod(copy.c_str(), nullptr);
+        return *this;
+    }
+
+    GET(ok, bool, good);
 };
-TRA_data_header::TRA_data_header_generator TRA_data_header::TRA_data_header_generator::sample;
 
-class TRA_ctrl_header : public header
+// 64-bit FNV-1a hash; it is used to key cache files by the input that produced them
+class fnv_hash
 {
-    TRA_ctrl_header(TRA_ctrl_header &) {} // cannot be called by users
-
-protected:
-    TRA_ctrl_header() {} // this constructor cannot be directly called by users
+    unsigned long long h = 14695981039346656037ULL;
 
 public:
-    ~TRA_ctrl_header() {}
-    string type() { return "TRA_ctrl_header"; }
-
-    class TRA_ctrl_header_generator;
-    friend class TRA_ctrl_header_generator;
-    // TRA_ctrl_header_generator is derived from header_generator to generate a header
-    class TRA_ctrl_header_generator : public header_generator
+    void add_bytes(const void *data, size_t n)
     {
-        static TRA_ctrl_header_generator sample;
-        // this constructor is only for sample to register this header type
-        TRA_ctrl_header_generator() { /*cout << "TRA_ctrl_header registered" << endl;*/ register_header_type(&sample); }
+        const unsigned char *c = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < n; i++)
+            h = (h ^ c[i]) * 1099511628211ULL;
+    }
+    template <typename T>
+    void add(const T &v) { add_bytes(&v, sizeof(T)); }
+    GET(value, unsigned long long, h);
+    string hex() const
+    {
+        char buf[17];
+        snprintf(buf, sizeof(buf), "%016llx", h);
+        return buf;
+    }
+};
 
-    protected:
-        virtual header *generate()
-        {
-            // cout << "TRA_ctrl_header generated" << endl;
-            return new TRA_ctrl_header;
-        }
+// splitmix64 is a small seeded generator; the generated traffic and topologies use it so that a seed gives the same
+// result with every compiler, which the distributions of <random> do not promise
+class splitmix64
+{
+    unsigned long long state;
 
-    public:
-        virtual string type() { return "TRA_ctrl_header"; }
-        ~TRA_ctrl_header_generator() {}
-    };
+public:
+    splitmix64(unsigned long long seed = 0) : state(seed) {}
+    unsigned long long next()
+    {
+        unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    // in (0, 1]
+    double uniform() { return double((next() >> 11) + 1) * (1.0 / 9007199254740992.0); }
+    // in [0, n)
+    uint below(uint n) { return min(uint(uniform() * n), n - 1); }
+    double exponential(double mean) { return -mean * log(uniform()); }
+    GET(getState, unsigned long long, state);
 };
-TRA_ctrl_header::TRA_ctrl_header_generator TRA_ctrl_header::TRA_ctrl_header_generator::sample;
 
-class payload
+// parse a comma-separated list of key=value into out; a key without '=' gets an empty value
+void parse_options(const string &spec, map<string, string> &out)
 {
-    payload(payload &) {} // this constructor cannot be directly called by users
+    size_t begin = 0;
+    while (begin < spec.size())
+    {
+        size_t comma = spec.find(',', begin);
+        if (comma == string::npos)
+            comma = spec.size();
+        string item = spec.substr(begin, comma - begin);
+        begin = comma + 1;
+        size_t eq = item.find('=');
+        out[item.substr(0, eq)] = (eq == string::npos) ? "" : item.substr(eq + 1);
+    }
+}
 
-    string msg;
+// latency_histogram counts values in log-linear buckets like an HDR histogram: 16 buckets per power of two,
+// so every percentile is within about 6% of the true value
+class latency_histogram
+{
+    static const uint SUB = 16;
+    vector<unsigned long long> counts = vector<unsigned long long>(64 * SUB);
+    unsigned long long n = 0, max_value = 0;
+    double sum = 0;
 
-protected:
-    payload() {}
+    static uint bucket(unsigned long long v)
+    {
+        if (v < SUB)
+            return v;
+        uint e = 63 - __builtin_clzll(v); // e >= 4
+        return (e - 3) * SUB + ((v >> (e - 4)) & (SUB - 1));
+    }
+    // the middle of the values falling into bucket b
+    static double value(uint b)
+    {
+        if (b < SUB)
+            return b;
+        uint e = b / SUB + 3;
+        return double((unsigned long long)(SUB + b % SUB) << (e - 4)) + double(1ULL << (e - 4)) / 2;
+    }
 
 public:
-    virtual ~payload() {}
-    virtual string type() = 0;
-
-    SET(setMsg, string, msg, _msg);
-    GET(getMsg, string, msg);
+    void record(unsigned long long v)
+    {
+        counts[bucket(v)]++;
+        n++;
+        sum += v;
+        max_value = max(max_value, v);
+    }
+    void merge(const latency_histogram &h)
+    {
+        for (uint b = 0; b < counts.size(); b++)
+            counts[b] += h.counts[b];
+        n += h.n;
+        sum += h.sum;
+        max_value = max(max_value, h.max_value);
+    }
+    double percentile(double q) const
+    {
+        unsigned long long rank = (unsigned long long)ceil(q * n), seen = 0;
+        for (uint b = 0; b < counts.size(); b++)
+            if ((seen += counts[b]) >= max(rank, 1ULL))
+                return min(value(b), double(max_value));
+        return 0;
+    }
+    void write_json(ostream &os) const
+    {
+        os << "{\"count\":" << n << ",\"mean\":" << (n ? sum / n : 0) << ",\"p50\":" << percentile(0.5)
+           << ",\"p90\":" << percentile(0.9) << ",\"p99\":" << percentile(0.99) << ",\"p999\":" << percentile(0.999)
+           << ",\"max\":" << max_value << "}";
+    }
+};
 
-    class payload_generator
+// sim_metrics collects the counters of --metrics: the events by type, the latency of recv_handler and send, the depth
+// of the event queue over simulated time, the packets replicated and discarded and the drops in node::send
+// every thread counts into its own block, and the blocks are only summed when the metrics are written
+class sim_metrics
+{
+public:
+    struct block
     {
-        // lock the copy constructor
-        payload_generator(payload_generator &) {}
-        // store all possible types of header
-        static map<string, payload_generator *> prototypes;
+        unordered_map<type_index, pair<string, unsigned long long>> events;
+        latency_histogram recv_ns, send_ns;
+        unsigned long long generated = 0, replicated = 0, discarded = 0, send_drops = 0;
+    };
 
-    protected:
-        // allow derived class to use it
-        payload_generator() {}
-        // after you create a new payload type, please register the factory of this payload type by this function
-        void register_payload_type(payload_generator *h) { prototypes[h->type()] = h; }
-        // you have to implement your own generate() to generate your payload
-        virtual payload *generate() = 0;
+private:
+    static bool enabled;
+    static string path;
+    static uint interval;
+    static uint next_sample;
+    static size_t max_depth;
+    static vector<pair<uint, size_t>> depth_samples; // (simulated time, queue depth)
+    static mutex blocks_lock;
+    static vector<block *> blocks; // never freed, so the counts of finished threads stay
+    static vector<pair<string, function<unsigned long long()>>> gauges;
+    static thread_local block *local;
 
-    public:
-        // you have to implement your own type() to return your header type
-        virtual string type() = 0;
-        // this function is used to generate any type of header derived
-        static payload *generate(string type)
+public:
+    static void enable(const string &_path, uint _interval)
+    {
+        enabled = true;
+        path = _path;
+        interval = _interval;
+    }
+    static bool isEnabled() { return enabled; }
+    static block &mine()
+    {
+        if (local == nullptr)
         {
-            if (prototypes.find(type) != prototypes.end())
-            {                                        // if this type derived exists
-                return prototypes[type]->generate(); // generate it!!
-            }
-            std::cerr << "no such payload type" << std::endl; // otherwise
-            return nullptr;
+            local = new block;
+            lock_guard<mutex> guard(blocks_lock);
+            blocks.push_back(local);
         }
-        static void print()
+        return *local;
+    }
+    static unsigned long long now_ns()
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // called for every event with the queue depth before it was taken
+    static void queue_depth(uint time, size_t depth)
+    {
+        max_depth = max(max_depth, depth);
+        if (interval > 0 && time >= next_sample)
         {
-            cout << "registered payload types: " << endl;
-            for (map<string, payload::payload_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
-                cout << it->second->type() << endl;
+            depth_samples.push_back({time, depth});
+            next_sample = (time / interval + 1) * interval;
         }
-        virtual ~payload_generator() {};
-    };
+    }
+    // a value read when the metrics are written, e.g., a counter kept elsewhere
+    static void add_gauge(const string &name, function<unsigned long long()> f) { gauges.push_back({name, f}); }
+    static bool write(uint cur_time);
 };
-map<string, payload::payload_generator *> payload::payload_generator::prototypes;
-
-class TRA_data_payload : public payload
+bool sim_metrics::enabled = false;
+string sim_metrics::path;
+uint sim_metrics::interval = 0;
+uint sim_metrics::next_sample = 0;
+size_t sim_metrics::max_depth = 0;
+vector<pair<uint, size_t>> sim_metrics::depth_samples;
+mutex sim_metrics::blocks_lock;
+vector<sim_metrics::block *> sim_metrics::blocks;
+vector<pair<string, function<unsigned long long()>>> sim_metrics::gauges;
+thread_local sim_metrics::block *sim_metrics::local = nullptr;
+
+// mem_accounting counts the objects and bytes of the simulator by kind for --mem-report
+// the base classes route their operator new and delete here, so a derived object is counted under its base with its own size
+class mem_accounting
 {
-    TRA_data_payload(TRA_data_payload &) {}
-
-protected:
-    TRA_data_payload() {} // this constructor cannot be directly called by users
 public:
-    ~TRA_data_payload() {}
-
-    string type() { return "TRA_data_payload"; }
+    enum kind
+    {
+        HEADER,
+        PAYLOAD,
+        PACKET,
+        EVENT,
+        NODE,
+        LINK,
+        KINDS
+    };
 
-    class TRA_data_payload_generator;
-    friend class TRA_data_payload_generator;
-    // TRA_data_payload is derived from payload_generator to generate a payload
-    class TRA_data_payload_generator : public payload_generator
+private:
+    static bool enabled;
+    static atomic<long long> live[KINDS];
+    static atomic<long long> bytes[KINDS];
+    static atomic<long long> peak[KINDS];
+    static atomic<unsigned long long> allocations[KINDS];
+    static atomic<long long> total_bytes;
+    static atomic<long long> total_peak;
+    static void raise(atomic<long long> &peak, long long value)
     {
-        static TRA_data_payload_generator sample;
-        // this constructor is only for sample to register this payload type
-        TRA_data_payload_generator() { /*cout << "TRA_data_payload registered" << endl;*/ register_payload_type(&sample); }
+        long long seen = peak.load(memory_order_relaxed);
+        while (value > seen && !peak.compare_exchange_weak(seen, value, memory_order_relaxed))
+            ;
+    }
 
-    protected:
-        virtual payload *generate()
+public:
+    static void enable() { enabled = true; }
+    static bool isEnabled() { return enabled; }
+    static void *allocate(kind k, size_t size)
+    {
+        void *p = ::operator new(size);
+        if (enabled)
         {
-            // cout << "TRA_data_payload generated" << endl;
-            return new TRA_data_payload;
+            live[k].fetch_add(1, memory_order_relaxed);
+            allocations[k].fetch_add(1, memory_order_relaxed);
+            raise(peak[k], bytes[k].fetch_add(size, memory_order_relaxed) + size);
+            raise(total_peak, total_bytes.fetch_add(size, memory_order_relaxed) + size);
         }
-
-    public:
-        virtual string type() { return "TRA_data_payload"; }
-        ~TRA_data_payload_generator() {}
-    };
+        return p;
+    }
+    static void release(kind k, void *p, size_t size)
+    {
+        if (enabled)
+        {
+            live[k].fetch_sub(1, memory_order_relaxed);
+            bytes[k].fetch_sub(size, memory_order_relaxed);
+            total_bytes.fetch_sub(size, memory_order_relaxed);
+        }
+        ::operator delete(p);
+    }
+    // the objects still live by kind, the TRA_switch tables and the events left in the queue with the packets they hold
+    static bool report(const string &path);
 };
-TRA_data_payload::TRA_data_payload_generator TRA_data_payload::TRA_data_payload_generator::sample;
-
-class TRA_ctrl_payload : public payload
+bool mem_accounting::enabled = false;
+atomic<long long> mem_accounting::live[mem_accounting::KINDS];
+atomic<long long> mem_accounting::bytes[mem_accounting::KINDS];
+atomic<long long> mem_accounting::peak[mem_accounting::KINDS];
+atomic<unsigned long long> mem_accounting::allocations[mem_accounting::KINDS];
+atomic<long long> mem_accounting::total_bytes(0);
+atomic<long long> mem_accounting::total_peak(0);
+
+// node_profiler keeps the load of every node for --profile-nodes: the recv and send events it handled, the replicas
+// it sent with their bytes and the cycles spent in its recv_handler, so the hot nodes of a skewed topology can be found
+class node_profiler
 {
-    TRA_ctrl_payload(TRA_ctrl_payload &s) : n_id(s.n_id), netw_info(s.netw_info) {} // counter (s.counter) {}
+public:
+    class profile
+    {
+    public:
+        unsigned long long recv_events = 0;
+        unsigned long long send_events = 0;
+        unsigned long long replicas = 0;
+        double bytes_replicated = 0;
+        unsigned long long cycles = 0; // in recv_handler
+    };
 
-    // uint counter ;
-    unsigned n_id = 0; // default is zero
-    map<uint, pair<double, double>> netw_info;
-    // nodeID, <first: capacity, second: occupied>
+private:
+    static bool enabled;
+    static vector<profile> profiles; // indexed by node id
+    static unsigned long long start_ticks;
+    static unsigned long long start_ns;
 
-protected:
-    TRA_ctrl_payload() {} // : counter (0) {} // this constructor cannot be directly called by users
 public:
-    ~TRA_ctrl_payload() {}
-
-    // void increase() { counter ++; } // used to increase the counter
-    // GET(getCounter,uint,counter); // used to get the value of counter
-    SET(setnid, uint, n_id, _n_id);
-    GET(getnid, uint, n_id);
-    void addNetwInfo(uint nb_id, double link_capacity, double occupied)
+    // the time stamp counter where there is one, and nanoseconds otherwise
+    static unsigned long long ticks()
     {
-        //  if (netw_info.find(nb_id) == netw_info.end())
-        netw_info[nb_id] = make_pair(link_capacity, occupied);
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
     }
-    map<uint, pair<double, double>> getNetwInfo()
+    static void enable()
     {
-        return netw_info;
+        enabled = true;
+        start_ticks = ticks();
+        start_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
     }
+    static bool isEnabled() { return enabled; }
+    static profile &of(uint id)
+    {
+        if (id >= profiles.size())
+            profiles.resize(id + 1);
+        return profiles[id];
+    }
+    // print the top nodes by recv_handler cycles to os and write every node's profile to path, one line per node
+    static bool write(const string &path, uint top, ostream &os);
+};
+bool node_profiler::enabled = false;
+vector<node_profiler::profile> node_profiler::profiles;
+unsigned long long node_profiler::start_ticks = 0;
+unsigned long long node_profiler::start_ns = 0;
 
-    string type() { return "TRA_ctrl_payload"; }
+bool node_profiler::write(const string &path, uint top, ostream &os)
+{
+    unsigned long long total = 0;
+    vector<uint> order;
+    for (uint id = 0; id < profiles.size(); id++)
+    {
+        total += profiles[id].cycles;
+        if (profiles[id].recv_events + profiles[id].send_events > 0)
+            order.push_back(id);
+    }
+    sort(order.begin(), order.end(), [](uint a, uint b)
+         { return profiles[a].cycles != profiles[b].cycles ? profiles[a].cycles > profiles[b].cycles : a < b; });
+
+    // the ticks are converted to time with their rate over the whole run
+    unsigned long long end_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    double ticks_per_ms = (end_ns > start_ns) ? (ticks() - start_ticks) / ((end_ns - start_ns) / 1e6) : 0;
+    os << setw(10) << "node" << setw(14) << "recv events" << setw(14) << "send events" << setw(12) << "replicas" << setw(16)
+       << "bytes" << setw(16) << "recv_handler" << setw(12) << "ms" << setw(8) << "share" << endl;
+    for (uint i = 0; i < order.size() && i < top; i++)
+    {
+        const profile &f = profiles[order[i]];
+        os << setw(10) << order[i] << setw(14) << f.recv_events << setw(14) << f.send_events << setw(12) << f.replicas << setw(16)
+           << fixed << setprecision(0) << f.bytes_replicated << setw(16) << f.cycles << setw(12) << setprecision(2)
+           << (ticks_per_ms > 0 ? f.cycles / ticks_per_ms : 0) << setw(7) << setprecision(1)
+           << (total ? 100.0 * f.cycles / total : 0.0) << "%" << endl;
+    }
+    os.unsetf(ios::floatfield);
+    os << setprecision(6);
 
-    class TRA_ctrl_payload_generator;
-    friend class TRA_ctrl_payload_generator;
-    // TRA_data_payload is derived from payload_generator to generate a payload
-    class TRA_ctrl_payload_generator : public payload_generator
+    ofstream out(path);
+    out << "# node recv_events send_events replicas bytes_replicated recv_handler_ticks" << endl;
+    for (uint id = 0; id < profiles.size(); id++)
     {
-        static TRA_ctrl_payload_generator sample;
-        // this constructor is only for sample to register this payload type
-        TRA_ctrl_payload_generator() { /*cout << "TRA_ctrl_payload registered" << endl;*/ register_payload_type(&sample); }
+        const profile &f = profiles[id];
+        out << id << ' ' << f.recv_events << ' ' << f.send_events << ' ' << f.replicas << ' ' << fixed << setprecision(0)
+            << f.bytes_replicated << ' ' << f.cycles << '\n';
+    }
+    return bool(out);
+}
 
-    protected:
-        virtual payload *generate()
+// put in a base class to count it and its derived classes under kind
+#define MEM_ACCOUNTED(kind)                                                                               \
+    static void *operator new(size_t size) { return mem_accounting::allocate(mem_accounting::kind, size); } \
+    static void operator delete(void *p, size_t size) { mem_accounting::release(mem_accounting::kind, p, size); }
+
+bool sim_metrics::write(uint cur_time)
+{
+    block total;
+    map<string, unsigned long long> events;
+    {
+        lock_guard<mutex> guard(blocks_lock);
+        for (block *b : blocks)
         {
-            // cout << "TRA_ctrl_payload generated" << endl;
-            return new TRA_ctrl_payload;
+            for (auto &it : b->events)
+                events[it.second.first] += it.second.second;
+            total.recv_ns.merge(b->recv_ns);
+            total.send_ns.merge(b->send_ns);
+            total.generated += b->generated;
+            total.replicated += b->replicated;
+            total.discarded += b->discarded;
+            total.send_drops += b->send_drops;
         }
+    }
+    unsigned long long events_total = 0;
+    ostringstream os;
+    os << "{\"time\":" << cur_time << ",\"events\":{";
+    for (auto it = events.begin(); it != events.end(); it++)
+    {
+        os << (it == events.begin() ? "" : ",") << "\"" << it->first << "\":" << it->second;
+        events_total += it->second;
+    }
+    os << "},\"events_total\":" << events_total << ",\"recv_handler_ns\":";
+    total.recv_ns.write_json(os);
+    os << ",\"send_ns\":";
+    total.send_ns.write_json(os);
+    os << ",\"queue_depth\":{\"max\":" << max_depth << ",\"samples\":[";
+    for (uint i = 0; i < depth_samples.size(); i++)
+        os << (i ? "," : "") << "[" << depth_samples[i].first << "," << depth_samples[i].second << "]";
+    os << "]},\"packets\":{\"generated\":" << total.generated << ",\"replicated\":" << total.replicated
+       << ",\"discarded\":" << total.discarded << "},\"send_drops\":" << total.send_drops << ",\"gauges\":{";
+    for (uint i = 0; i < gauges.size(); i++)
+        os << (i ? "," : "") << "\"" << gauges[i].first << "\":" << gauges[i].second();
+    os << "}}\n";
+
+    snapshot_writer w;
+    string json = os.str();
+    w.put_array(vector<char>(json.begin(), json.end()));
+    return w.write_to(path);
+}
 
-    public:
-        virtual string type() { return "TRA_ctrl_payload"; }
-        ~TRA_ctrl_payload_generator() {}
-    };
-};
-TRA_ctrl_payload::TRA_ctrl_payload_generator TRA_ctrl_payload::TRA_ctrl_payload_generator::sample;
-
-class packet
+// inline_vector keeps its first N elements inside the object and only allocates for the ones after them,
+// so copying a short one never touches the heap
+template <typename T, uint N>
+class inline_vector
 {
-    // a packet usually contains a header and a payload
-    header *hdr;
-    payload *pld;
-    uint p_id;
-    static uint last_packet_id;
-
-    packet(packet &) {}
-    static int live_packet_num;
+    T inline_items[N] = {};
+    vector<T> spilled;
+    uint n = 0;
 
-protected:
-    double size = 0; // packet size (flow size) is set to 0 by default (especially for control msg)
+public:
+    void push_back(const T &v)
+    {
+        if (n < N)
+            inline_items[n] = v;
+        else
+            spilled.push_back(v);
+        n++;
+    }
+    void pop_back()
+    {
+        n--;
+        if (n >= N)
+            spilled.pop_back();
+    }
+    const T &operator[](uint i) const { return (i < N) ? inline_items[i] : spilled[i - N]; }
+    const T &back() const { return (*this)[n - 1]; }
+    uint size() const { return n; }
+    bool empty() const { return n == 0; }
+    void clear()
+    {
+        n = 0;
+        spilled.clear();
+    }
+};
 
-    // these constructors cannot be directly called by users
-    packet() : hdr(nullptr), pld(nullptr)
+// visited_set is an exact set of node ids for the hops of one path; the first ids are kept inline, and a 64-bit
+// Bloom word answers most misses without scanning them; a longer path spills into an open-addressing table taken
+// from a pool, so that a hop neither allocates nor scans once the pool is warm
+class visited_set
+{
+    static const uint INLINE = 8;
+    static const uint EMPTY = UINT_MAX; // never a node id
+    unsigned long long bloom = 0;
+    uint n = 0;
+    uint inline_ids[INLINE] = {};
+    uint *table = nullptr; // once spilled, every member in capacity slots, at most half full
+    uint capacity = 0;     // a power of two
+    static vector<vector<uint *>> pool; // free tables by log2 of their capacity; only the simulation thread uses it
+
+    static unsigned long long bit(uint id) { return 1ULL << (id * 0x9E3779B1u >> 26); }
+    static uint slot(uint id, uint cap) { return (id * 0x9E3779B1u) & (cap - 1); }
+    static uint *take(uint cap)
     {
-        p_id = last_packet_id++;
-        live_packet_num++;
+        uint k = __builtin_ctz(cap);
+        if (k < pool.size() && !pool[k].empty())
+        {
+            uint *t = pool[k].back();
+            pool[k].pop_back();
+            return t;
+        }
+        return new uint[cap];
     }
-    packet(string _hdr, string _pld, double _size = 0, bool rep = false, uint rep_id = 0)
+    static void give(uint *t, uint cap)
     {
-        if (!rep) // a duplicated packet does not have a new packet id
-            p_id = last_packet_id++;
+        uint k = __builtin_ctz(cap);
+        if (k >= pool.size())
+            pool.resize(k + 1);
+        pool[k].push_back(t);
+    }
+    void release()
+    {
+        if (table != nullptr)
+            give(table, capacity);
+        table = nullptr;
+        capacity = 0;
+    }
+    void place(uint id)
+    {
+        uint i = slot(id, capacity);
+        while (table[i] != EMPTY)
+            i = (i + 1) & (capacity - 1);
+        table[i] = id;
+    }
+    // move the members into a table twice as large (32 slots for the first spill)
+    void grow()
+    {
+        uint *old = table;
+        uint old_capacity = capacity;
+        capacity = old ? 2 * old_capacity : 32;
+        table = take(capacity);
+        fill(table, table + capacity, EMPTY);
+        if (old == nullptr)
+            for (uint i = 0; i < n; i++)
+                place(inline_ids[i]);
         else
-            p_id = rep_id;
-        hdr = header::header_generator::generate(_hdr);
-        pld = payload::payload_generator::generate(_pld);
-        size = _size;
-        live_packet_num++;
+        {
+            for (uint i = 0; i < old_capacity; i++)
+                if (old[i] != EMPTY)
+                    place(old[i]);
+            give(old, old_capacity);
+        }
     }
 
 public:
-    virtual ~packet()
+    visited_set() {}
+    visited_set(const visited_set &s) { *this = s; }
+    visited_set &operator=(const visited_set &s)
     {
-        // cout << "packet destructor begin" << endl;
-        if (hdr != nullptr)
-            delete hdr;
-        if (pld != nullptr)
-            delete pld;
-        live_packet_num--;
-        // cout << "packet destructor end" << endl;
+        if (this == &s)
+            return *this;
+        if (capacity != s.capacity)
+        {
+            release();
+            if (s.table != nullptr)
+            {
+                capacity = s.capacity;
+                table = take(capacity);
+            }
+        }
+        bloom = s.bloom;
+        n = s.n;
+        memcpy(inline_ids, s.inline_ids, sizeof(inline_ids));
+        if (table != nullptr)
+            memcpy(table, s.table, capacity * sizeof(uint));
+        return *this;
     }
+    ~visited_set() { release(); }
 
-    SET(setHeader, header *, hdr, _hdr);
-    GET(getHeader, header *, hdr);
-    SET(setPayload, payload *, pld, _pld);
-    GET(getPayload, payload *, pld);
-    GET(getPacketID, uint, p_id);
-
-    SET(setSize, uint, size, _size);
-    GET(getSize, uint, size);
-
-    static void discard(packet *&p)
+    bool contains(uint id) const
     {
-        // cout << "checking" << endl;
-        if (p != nullptr)
+        if (!(bloom & bit(id)))
+            return false;
+        if (table == nullptr)
         {
-            // cout << "discarding" << endl;
-            // cout << p->type() << endl;
-            delete p;
-            // cout << "discarded" << endl;
+            for (uint i = 0; i < n; i++)
+                if (inline_ids[i] == id)
+                    return true;
+            return false;
         }
-        p = nullptr;
-        // cout << "checked" << endl;
+        for (uint i = slot(id, capacity); table[i] != EMPTY; i = (i + 1) & (capacity - 1))
+            if (table[i] == id)
+                return true;
+        return false;
     }
+    void insert(uint id)
+    {
+        if (contains(id))
+            return;
+        bloom |= bit(id);
+        if (table == nullptr && n < INLINE)
+            inline_ids[n] = id;
+        else
+        {
+            if (table == nullptr || 2 * (n + 1) > capacity)
+                grow();
+            place(id);
+        }
+        n++;
+    }
+    uint size() const { return n; }
+    // call f on every member
+    template <typename F>
+    void for_each(F f) const
+    {
+        if (table == nullptr)
+            for (uint i = 0; i < n; i++)
+                f(inline_ids[i]);
+        else
+            for (uint i = 0; i < capacity; i++)
+                if (table[i] != EMPTY)
+                    f(table[i]);
+    }
+    void clear()
+    {
+        release();
+        bloom = 0;
+        n = 0;
+    }
+};
+const uint visited_set::INLINE;
+const uint visited_set::EMPTY;
+vector<vector<uint *>> visited_set::pool;
+
+// a timer_handle identifies a timer in the timer_wheel; it becomes stale once the timer fires or is cancelled
+class timer_handle
+{
+public:
+    uint slot = UINT_MAX;
+    uint gen = 0;
+    bool valid() const { return slot != UINT_MAX; }
+};
+
+// an event_handle is returned when an event is generated; it can be used to cancel the event before it fires
+// it becomes stale once the event fires or is cancelled, and it is not kept across a snapshot restore
+class event_handle
+{
+public:
+    uint slot = UINT_MAX;
+    uint gen = 0;
+    bool valid() const { return slot != UINT_MAX; }
+};
+
+class header
+{
+public:
+    virtual ~header() {}
+    MEM_ACCOUNTED(HEADER)
+
+    SET(setSrcID, uint, srcID, _srcID);
+    SET(setDstID, uint, dstID, _dstID);
+    SET(setPreID, uint, preID, _preID);
+    SET(setNexID, uint, nexID, _nexID);
+    GET(getSrcID, uint, srcID);
+    GET(getDstID, uint, dstID);
+    GET(getPreID, uint, preID);
+    GET(getNexID, uint, nexID);
+
     virtual string type() = 0;
-    // you can define your own packet's addition_information
-    // to print more information for recv_event and send_event
-    virtual string addition_information() { return ""; }
 
-    static int getLivePacketNum() { return live_packet_num; }
+    // save/load the header for checkpointing; a derived header appends its own fields after these
+    virtual void save(snapshot_writer &w) const
+    {
+        w.put(srcID);
+        w.put(dstID);
+        w.put(preID);
+        w.put(nexID);
+    }
+    virtual void load(snapshot_reader &r)
+    {
+        srcID = r.get<uint>();
+        dstID = r.get<uint>();
+        preID = r.get<uint>();
+        nexID = r.get<uint>();
+    }
 
-    class packet_generator;
-    friend class packet_generator;
-    class packet_generator
+    // factory concept: generate a header
+    class header_generator
     {
         // lock the copy constructor
-        packet_generator(packet_generator &) {}
-        // store all possible types of packet
-        static map<string, packet_generator *> prototypes;
+        header_generator(header_generator &) {}
+        // store all possible types of header
+        static map<string, header_generator *> prototypes;
 
     protected:
         // allow derived class to use it
-        packet_generator() {}
-        // after you create a new packet type, please register the factory of this payload type by this function
-        void register_packet_type(packet_generator *h) { prototypes[h->type()] = h; }
-        // you have to implement your own generate() to generate your payload
-        virtual packet *generate(packet *p = nullptr) = 0;
+        header_generator() {}
+        // after you create a new header type, please register the factory of this header type by this function
+        void register_header_type(header_generator *h) { prototypes[h->type()] = h; }
+        // you have to implement your own generate() to generate your header
+        virtual header *generate() = 0;
 
     public:
-        // you have to implement your own type() to return your packet type
+        // you have to implement your own type() to return your header type
         virtual string type() = 0;
-        // this function is used to generate any type of packet derived
-        static packet *generate(string type)
+        // this function is used to generate any type of header derived
+        static header *generate(string type)
         {
             if (prototypes.find(type) != prototypes.end())
             {                                        // if this type derived exists
                 return prototypes[type]->generate(); // generate it!!
             }
-            std::cerr << "no such packet type" << std::endl; // otherwise
-            return nullptr;
-        }
-        static packet *replicate(packet *p)
-        {
-            if (prototypes.find(p->type()) != prototypes.end())
-            {                                              // if this type derived exists
-                return prototypes[p->type()]->generate(p); // generate it!!
-            }
-            std::cerr << "no such packet type" << std::endl; // otherwise
+            std::cerr << "no such header type" << std::endl; // otherwise
             return nullptr;
         }
         static void print()
         {
-            cout << "registered packet types: " << endl;
-            for (map<string, packet::packet_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
+            cout << "registered header types: " << endl;
+            for (map<string, header::header_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
                 cout << it->second->type() << endl;
         }
-        virtual ~packet_generator() {};
+        virtual ~header_generator() {};
     };
+
+protected:
+    header() : srcID(BROCAST_ID), dstID(BROCAST_ID), preID(BROCAST_ID), nexID(BROCAST_ID) {} // this constructor cannot be directly called by users
+
+private:
+    uint srcID;
+    uint dstID;
+    uint preID;
+    uint nexID;
+    header(header &) {} // this constructor cannot be directly called by users
 };
-map<string, packet::packet_generator *> packet::packet_generator::prototypes;
-uint packet::last_packet_id = 0;
-int packet::live_packet_num = 0;
+map<string, header::header_generator *> header::header_generator::prototypes;
 
-// this packet is used to tell the destination the msg
-class TRA_data_packet : public packet
+class TRA_data_header : public header
 {
-    TRA_data_packet(TRA_data_packet &) {}
+    TRA_data_header(TRA_data_header &s) : labels(s.labels) {} // cannot be called by users
+
+    uint used_labels = 0;
+    inline_vector<uint, 8> labels; // the label stack, bottom first; it holds at most about nLabel labels
+    visited_set hi;
+    double flow_size = 0; // the size before packet::setSize truncates it; only --cspf routes by it
 
 protected:
-    TRA_data_packet() {} // this constructor cannot be directly called by users
-    TRA_data_packet(packet *p) : packet(p->getHeader()->type(), p->getPayload()->type(), p->getSize(), true, p->getPacketID())
-    {
-        *(dynamic_cast<TRA_data_header *>(this->getHeader())) = *(dynamic_cast<TRA_data_header *>(p->getHeader()));
-        *(dynamic_cast<TRA_data_payload *>(this->getPayload())) = *(dynamic_cast<TRA_data_payload *>(p->getPayload()));
-        // DFS_path = (dynamic_cast<TRA_data_header*>(p))->DFS_path;
-        // isVisited = (dynamic_cast<TRA_data_header*>(p))->isVisited;
-    } // for duplicate
-    TRA_data_packet(string _h, string _p, double _size = 0) : packet(_h, _p, _size) {}
+    TRA_data_header() {} // this constructor cannot be directly called by users
 
 public:
-    virtual ~TRA_data_packet() {}
-    string type() { return "TRA_data_packet"; }
-    virtual string addition_information()
+    ~TRA_data_header() {}
+    string type() { return "TRA_data_header"; }
+
+    void push_label(uint _id)
     {
-        double size = getSize();
-        // cout << counter << endl;
-        TRA_data_header *_hdr = dynamic_cast<TRA_data_header *>(getHeader());
-        uint label = 0;
-        if (_hdr && _hdr->get_num_labels())
-            return " label " + to_string(_hdr->get_label()); // " size " + to_string(size);
-        return " label x";
+        if (_id == getSrcID() || _id == get_label() || getNexID() == get_label())
+            used_labels += 1;
+        else
+            used_labels += 2;
+        labels.push_back(_id);
     }
+    void pop_label() { labels.pop_back(); }
+    uint get_num_labels() { return labels.size(); } // although the original returned value's type size_t, we change it for simplicity
+    uint get_label() { return labels.size() ? labels.back() : 0; }
+    uint get_label_at(uint i) { return labels[i]; } // counted from the bottom
+    uint get_used_labels() { return used_labels; }
 
-    class TRA_data_packet_generator;
-    friend class TRA_data_packet_generator;
-    // TRA_data_packet is derived from packet_generator to generate a pub packet
-    class TRA_data_packet_generator : public packet_generator
+    void visit(uint node_id) { hi.insert(node_id); }
+    bool visited(uint node_id) { return hi.contains(node_id); }
+
+    SET(setFlowSize, double, flow_size, _flow_size);
+    GET(getFlowSize, double, flow_size);
+
+    virtual void save(snapshot_writer &w) const
     {
-        static TRA_data_packet_generator sample;
-        // this constructor is only for sample to register this packet type
-        TRA_data_packet_generator() { /*cout << "TRA_data_packet registered" << endl;*/ register_packet_type(&sample); }
+        header::save(w);
+        w.put(used_labels);
+        w.put(labels.size());
+        for (uint i = 0; i < labels.size(); i++)
+            w.put(labels[i]);
+        w.put(hi.size());
+        hi.for_each([&](uint id)
+                    { w.put(id); });
+        w.put(flow_size);
+    }
+    virtual void load(snapshot_reader &r)
+    {
+        header::load(r);
+        used_labels = r.get<uint>();
+        labels.clear();
+        for (uint n = r.get<uint>(); n > 0 && r.ok(); n--)
+            labels.push_back(r.get<uint>());
+        hi.clear();
+        for (uint n = r.get<uint>(); n > 0 && r.ok(); n--)
+            hi.insert(r.get<uint>());
+        flow_size = r.get<double>();
+    }
+
+    class TRA_data_header_generator;
+    friend class TRA_data_header_generator;
+    // TRA_data_header_generator is derived from header_generator to generate a header
+    class TRA_data_header_generator : public header_generator
+    {
+        static TRA_data_header_generator sample;
+        // this constructor is only for sample to register this header type
+        TRA_data_header_generator() { /*cout << "TRA_data_header registered" << endl;*/ register_header_type(&sample); }
 
     protected:
-        virtual packet *generate(packet *p = nullptr)
+        virtual header *generate()
         {
-            // cout << "TRA_data_packet generated" << endl;
-            if (nullptr == p)
-                return new TRA_data_packet("TRA_data_header", "TRA_data_payload"); // generate a new packet
-            else
-                return new TRA_data_packet(p); // duplicate
+            // cout << "TRA_data_header generated" << endl;
+            return new TRA_data_header;
         }
 
     public:
-        virtual string type() { return "TRA_data_packet"; }
-        ~TRA_data_packet_generator() {}
+        virtual string type() { return "TRA_data_header"; }
+        ~TRA_data_header_generator() {}
     };
 };
-TRA_data_packet::TRA_data_packet_generator TRA_data_packet::TRA_data_packet_generator::sample;
+TRA_data_header::TRA_data_header_generator TRA_data_header::TRA_data_header_generator::sample;
 
-// this packet type is used to tell the node what should be installed in the routing table
-class TRA_ctrl_packet : public packet
+class TRA_ctrl_header : public header
 {
-    TRA_ctrl_packet(TRA_ctrl_packet &) {}
+    TRA_ctrl_header(TRA_ctrl_header &) {} // cannot be called by users
 
 protected:
-    TRA_ctrl_packet() {} // this constructor cannot be directly called by users
-    TRA_ctrl_packet(packet *p) : packet(p->getHeader()->type(), p->getPayload()->type(), p->getSize(), true, p->getPacketID())
-    {
-        *(dynamic_cast<TRA_ctrl_header *>(this->getHeader())) = *(dynamic_cast<TRA_ctrl_header *>(p->getHeader()));
-        *(dynamic_cast<TRA_ctrl_payload *>(this->getPayload())) = *(dynamic_cast<TRA_ctrl_payload *>(p->getPayload()));
-        // DFS_path = (dynamic_cast<TRA_ctrl_header*>(p))->DFS_path;
-        // isVisited = (dynamic_cast<TRA_ctrl_header*>(p))->isVisited;
-    } // for duplicate
-    TRA_ctrl_packet(string _h, string _p, double _size = 0) : packet(_h, _p, _size) {}
+    TRA_ctrl_header() {} // this constructor cannot be directly called by users
 
 public:
-    virtual ~TRA_ctrl_packet() {}
-    string type() { return "TRA_ctrl_packet"; }
-    virtual string addition_information()
-    {
-        // uint counter = (dynamic_cast<TRA_ctrl_payload*>(this->getPayload()))->getCounter();
-        uint id = (dynamic_cast<TRA_ctrl_payload *>(this->getPayload()))->getnid();
-        // cout << counter << endl;
-        return " from " + to_string(id);
-    }
+    ~TRA_ctrl_header() {}
+    string type() { return "TRA_ctrl_header"; }
 
-    class TRA_ctrl_packet_generator;
-    friend class TRA_ctrl_packet_generator;
-    // TRA_ctrl_packet is derived from packet_generator to generate a pub packet
-    class TRA_ctrl_packet_generator : public packet_generator
+    class TRA_ctrl_header_generator;
+    friend class TRA_ctrl_header_generator;
+    // TRA_ctrl_header_generator is derived from header_generator to generate a header
+    class TRA_ctrl_header_generator : public header_generator
     {
-        static TRA_ctrl_packet_generator sample;
-        // this constructor is only for sample to register this packet type
-        TRA_ctrl_packet_generator() { /*cout << "TRA_ctrl_packet registered" << endl;*/ register_packet_type(&sample); }
+        static TRA_ctrl_header_generator sample;
+        // this constructor is only for sample to register this header type
+        TRA_ctrl_header_generator() { /*cout << "TRA_ctrl_header registered" << endl;*/ register_header_type(&sample); }
 
     protected:
-        virtual packet *generate(packet *p = nullptr)
+        virtual header *generate()
         {
-            // cout << "TRA_ctrl_packet generated" << endl;
-            if (nullptr == p)
-                return new TRA_ctrl_packet("TRA_ctrl_header", "TRA_ctrl_payload"); // generate a new packet
-            else
-                return new TRA_ctrl_packet(p); // duplicate
+            // cout << "TRA_ctrl_header generated" << endl;
+            return new TRA_ctrl_header;
         }
 
     public:
-        virtual string type() { return "TRA_ctrl_packet"; }
-        ~TRA_ctrl_packet_generator() {}
+        virtual string type() { return "TRA_ctrl_header"; }
+        ~TRA_ctrl_header_generator() {}
     };
 };
-TRA_ctrl_packet::TRA_ctrl_packet_generator TRA_ctrl_packet::TRA_ctrl_packet_generator::sample;
+TRA_ctrl_header::TRA_ctrl_header_generator TRA_ctrl_header::TRA_ctrl_header_generator::sample;
 
-class node
+class payload
 {
-    // all nodes created in the program
-    static map<uint, node *> id_node_table;
-    map<uint, bool> phy_neighbors;
-    uint id;
-    uint num_of_label;
+    payload(payload &) {} // this constructor cannot be directly called by users
+
+    string msg;
 
 protected:
-    node(node &) {} // this constructor should not be used
-    node() {}       // this constructor should not be used
-    node(uint _id) : id(_id) { id_node_table[_id] = this; }
-    virtual void print_to(ostream &os) const { os << id << endl; }
+    payload() {}
 
 public:
-    virtual ~node()
-    { // erase the node
-        id_node_table.erase(id);
-    }
-    friend ostream &operator<<(ostream &os, const node &n);
-
-    virtual string type() = 0; // please define it in your derived node class
-
-    void add_phy_neighbor(uint _id, string link_type = "simple_link", map<string, double> link_args = {}); // we only add a directed link from id to _id
-    void del_phy_neighbor(uint _id);                                                                       // we only delete a directed link from id to _id
-
-    // you can use the function to get the node's neigbhors at this time
-    const map<uint, bool> &getPhyNeighbors()
-    {
-        return phy_neighbors;
-    }
-
-    link *getLink(uint nb_id);
-
-    void recv(packet *p)
-    {
-        packet *tp = p;
-        recv_handler(tp);
-        packet::discard(p);
-    } // the packet will be directly deleted after the handler
-    void send(packet *p);
-
-    // receive the packet and do something; this is a pure virtual function
-    virtual void recv_handler(packet *p) = 0;
-    void send_handler(packet *P);
+    virtual ~payload() {}
+    MEM_ACCOUNTED(PAYLOAD)
+    virtual string type() = 0;
 
-    static node *id_to_node(uint _id) { return ((id_node_table.find(_id) != id_node_table.end()) ? id_node_table[_id] : nullptr); }
-    GET(getNodeID, uint, id);
-    GET(getNumOfLabel, uint, num_of_label);
-    SET(setNumOfLabel, uint, num_of_label, _num_of_label);
+    SET(setMsg, string, msg, _msg);
+    GET(getMsg, string, msg);
 
-    static void del_node(uint _id)
-    {
-        if (id_node_table.find(_id) != id_node_table.end())
-            id_node_table.erase(_id);
-    }
-    static uint getNodeNum() { return id_node_table.size(); }
+    // save/load the payload for checkpointing; a derived payload appends its own fields after these
+    virtual void save(snapshot_writer &w) const { w.put_str(msg); }
+    virtual void load(snapshot_reader &r) { msg = r.get_str(); }
 
-    class node_generator
+    class payload_generator
     {
         // lock the copy constructor
-        node_generator(node_generator &) {}
-        // store all possible types of node
-        static map<string, node_generator *> prototypes;
+        payload_generator(payload_generator &) {}
+        // store all possible types of header
+        static map<string, payload_generator *> prototypes;
 
     protected:
         // allow derived class to use it
-        node_generator() {}
-        // after you create a new node type, please register the factory of this node type by this function
-        void register_node_type(node_generator *h) { prototypes[h->type()] = h; }
-        // you have to implement your own generate() to generate your node
-        virtual node *generate(uint _id) = 0;
+        payload_generator() {}
+        // after you create a new payload type, please register the factory of this payload type by this function
+        void register_payload_type(payload_generator *h) { prototypes[h->type()] = h; }
+        // you have to implement your own generate() to generate your payload
+        virtual payload *generate() = 0;
 
     public:
-        // you have to implement your own type() to return your node type
+        // you have to implement your own type() to return your header type
         virtual string type() = 0;
-        // this function is used to generate any type of node derived
-        static node *generate(string type, uint _id)
+        // this function is used to generate any type of header derived
+        static payload *generate(string type)
         {
-            if (id_node_table.find(_id) != id_node_table.end())
-            {
-                std::cerr << "duplicate node id" << std::endl; // node id is duplicated
-                return nullptr;
-            }
-            else if (BROCAST_ID == _id)
-            {
-                cerr << "BROCAST_ID cannot be used" << endl;
-                return nullptr;
-            }
-            else if (prototypes.find(type) != prototypes.end())
-            { // if this type derived exists
-                node *created_node = prototypes[type]->generate(_id);
-                return created_node; // generate it!!
+            if (prototypes.find(type) != prototypes.end())
+            {                                        // if this type derived exists
+                return prototypes[type]->generate(); // generate it!!
             }
-            std::cerr << "no such node type" << std::endl; // otherwise
+            std::cerr << "no such payload type" << std::endl; // otherwise
             return nullptr;
         }
         static void print()
         {
-            cout << "registered node types: " << endl;
-            for (map<string, node::node_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
+            cout << "registered payload types: " << endl;
+            for (map<string, payload::payload_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
                 cout << it->second->type() << endl;
         }
-        virtual ~node_generator() {};
+        virtual ~payload_generator() {};
     };
 };
-map<string, node::node_generator *> node::node_generator::prototypes;
-map<uint, node *> node::id_node_table;
+map<string, payload::payload_generator *> payload::payload_generator::prototypes;
 
-class TRA_switch : public node
+class TRA_data_payload : public payload
 {
-    // you can extract the data structure for storing nodes and links here from hw1
-    // note the data stored here should be local and cannot be accessed by the other nodes directly
-    map<uint, uint> last_p_id_from_node;
-    map<uint, vector<uint>> entry_table;
-    map<pair<uint, uint>, pair<double, double>> network; // {(src, nb), (capacity, occupied)}
+    TRA_data_payload(TRA_data_payload &) {}
 
 protected:
-    TRA_switch() {}                     // it should not be used
-    TRA_switch(TRA_switch &) {}         // it should not be used
-    TRA_switch(uint _id) : node(_id) {} // this constructor cannot be directly called by users
-    virtual void print_to(ostream &os) const override;
-
+    TRA_data_payload() {} // this constructor cannot be directly called by users
 public:
-    ~TRA_switch() {}
-    string type() { return "TRA_switch"; }
-
-    // please define recv_handler function to deal with the incoming packet
-    bool isNewPacket(packet *p);
-    virtual void recv_handler(packet *p);
-
-    double getCapacity(uint nb_id);
-    double getOccupied(uint nb_id);
+    ~TRA_data_payload() {}
 
-    // void add_one_hop_neighbor (uint n_id) { one_hop_neighbors[n_id] = true; }
-    // uint get_one_hop_neighbor_num () { return one_hop_neighbors.size(); }
+    string type() { return "TRA_data_payload"; }
 
-    class TRA_switch_generator;
-    friend class TRA_switch_generator;
-    // TRA_switch is derived from node_generator to generate a node
-    class TRA_switch_generator : public node_generator
+    class TRA_data_payload_generator;
+    friend class TRA_data_payload_generator;
+    // TRA_data_payload is derived from payload_generator to generate a payload
+    class TRA_data_payload_generator : public payload_generator
     {
-        static TRA_switch_generator sample;
-        // this constructor is only for sample to register this node type
-        TRA_switch_generator() { /*cout << "TRA_switch registered" << endl;*/ register_node_type(&sample); }
+        static TRA_data_payload_generator sample;
+        // this constructor is only for sample to register this payload type
+        TRA_data_payload_generator() { /*cout << "TRA_data_payload registered" << endl;*/ register_payload_type(&sample); }
 
     protected:
-        virtual node *generate(uint _id) { /*cout << "TRA_switch generated" << endl;*/ return new TRA_switch(_id); }
+        virtual payload *generate()
+        {
+            // cout << "TRA_data_payload generated" << endl;
+            return new TRA_data_payload;
+        }
 
     public:
-        virtual string type() { return "TRA_switch"; }
-        ~TRA_switch_generator() {}
+        virtual string type() { return "TRA_data_payload"; }
+        ~TRA_data_payload_generator() {}
     };
 };
-TRA_switch::TRA_switch_generator TRA_switch::TRA_switch_generator::sample;
+TRA_data_payload::TRA_data_payload_generator TRA_data_payload::TRA_data_payload_generator::sample;
 
-class mycomp
+class TRA_ctrl_payload : public payload
 {
-    bool reverse;
+    TRA_ctrl_payload(TRA_ctrl_payload &s) : n_id(s.n_id), netw_info(s.netw_info), seq(s.seq), full(s.full) {} // counter (s.counter) {}
+
+    // uint counter ;
+    unsigned n_id = 0; // default is zero
+    map<uint, pair<double, double>> netw_info;
+    // nodeID, <first: capacity, second: occupied>
+    uint seq = 0;     // the origin's LSA sequence number
+    bool full = true; // false if netw_info only holds the adjacencies changed since the origin's previous LSA
 
+protected:
+    TRA_ctrl_payload() {} // : counter (0) {} // this constructor cannot be directly called by users
 public:
-    mycomp(const bool &revparam = false) { reverse = revparam; }
-    bool operator()(const event *lhs, const event *rhs) const;
+    ~TRA_ctrl_payload() {}
+
+    // void increase() { counter ++; } // used to increase the counter
+    // GET(getCounter,uint,counter); // used to get the value of counter
+    SET(setnid, uint, n_id, _n_id);
+    GET(getnid, uint, n_id);
+    SET(setSeq, uint, seq, _seq);
+    GET(getSeq, uint, seq);
+    SET(setFull, bool, full, _full);
+    GET(isFull, bool, full);
+    void addNetwInfo(uint nb_id, double link_capacity, double occupied)
+    {
+        //  if (netw_info.find(nb_id) == netw_info.end())
+        netw_info[nb_id] = make_pair(link_capacity, occupied);
+    }
+    map<uint, pair<double, double>> getNetwInfo()
+    {
+        return netw_info;
+    }
+
+    virtual void save(snapshot_writer &w) const
+    {
+        payload::save(w);
+        w.put(n_id);
+        w.put(seq);
+        w.put(full);
+        w.put<uint>(netw_info.size());
+        for (auto it = netw_info.begin(); it != netw_info.end(); it++)
+        {
+            w.put(it->first);
+            w.put(it->second.first);
+            w.put(it->second.second);
+        }
+    }
+    virtual void load(snapshot_reader &r)
+    {
+        payload::load(r);
+        n_id = r.get<unsigned>();
+        seq = r.get<uint>();
+        full = r.get<bool>();
+        netw_info.clear();
+        for (uint n = r.get<uint>(); n > 0 && r.ok(); n--)
+        {
+            uint nb_id = r.get<uint>();
+            double capacity = r.get<double>();
+            double occupied = r.get<double>();
+            netw_info[nb_id] = make_pair(capacity, occupied);
+        }
+    }
+
+    string type() { return "TRA_ctrl_payload"; }
+
+    class TRA_ctrl_payload_generator;
+    friend class TRA_ctrl_payload_generator;
+    // TRA_data_payload is derived from payload_generator to generate a payload
+    class TRA_ctrl_payload_generator : public payload_generator
+    {
+        static TRA_ctrl_payload_generator sample;
+        // this constructor is only for sample to register this payload type
+        TRA_ctrl_payload_generator() { /*cout << "TRA_ctrl_payload registered" << endl;*/ register_payload_type(&sample); }
+
+    protected:
+        virtual payload *generate()
+        {
+            // cout << "TRA_ctrl_payload generated" << endl;
+            return new TRA_ctrl_payload;
+        }
+
+    public:
+        virtual string type() { return "TRA_ctrl_payload"; }
+        ~TRA_ctrl_payload_generator() {}
+    };
 };
+TRA_ctrl_payload::TRA_ctrl_payload_generator TRA_ctrl_payload::TRA_ctrl_payload_generator::sample;
 
-class event
+class packet
 {
-    event(event *&) {} // this constructor cannot be directly called by users
-    static priority_queue<event *, vector<event *>, mycomp> events;
-    static uint cur_time; // timer
-    static uint end_time;
+    // a packet usually contains a header and a payload
+    header *hdr;
+    payload *pld;
+    uint p_id;
+    static uint last_packet_id;
 
-    // get the next event
-    static event *get_next_event();
-    static void add_event(event *e) { events.push(e); }
-    static hash<string> event_seq;
+    packet(packet &) {}
+    static int live_packet_num;
 
 protected:
-    uint trigger_time;
+    double size = 0; // packet size (flow size) is set to 0 by default (especially for control msg)
 
-    event() {} // it should not be used
-    event(uint _trigger_time) : trigger_time(_trigger_time) {}
+    // these constructors cannot be directly called by users
+    packet() : hdr(nullptr), pld(nullptr)
+    {
+        p_id = last_packet_id++;
+        live_packet_num++;
+    }
+    packet(string _hdr, string _pld, double _size = 0, bool rep = false, uint rep_id = 0)
+    {
+        if (!rep) // a duplicated packet does not have a new packet id
+            p_id = last_packet_id++;
+        else
+            p_id = rep_id;
+        hdr = header::header_generator::generate(_hdr);
+        pld = payload::payload_generator::generate(_pld);
+        size = _size;
+        live_packet_num++;
+    }
 
 public:
-    virtual void trigger() = 0;
-    virtual ~event() {}
-
-    virtual uint event_priority() const = 0;
-    uint get_hash_value(string string_for_hash) const
+    virtual ~packet()
     {
-        uint priority = event_seq(string_for_hash);
-        return priority;
+        // cout << "packet destructor begin" << endl;
+        if (hdr != nullptr)
+            delete hdr;
+        if (pld != nullptr)
+            delete pld;
+        live_packet_num--;
+        // cout << "packet destructor end" << endl;
     }
+    MEM_ACCOUNTED(PACKET)
 
-    static void flush_events(); // only for debug
+    SET(setHeader, header *, hdr, _hdr);
+    GET(getHeader, header *, hdr);
+    SET(setPayload, payload *, pld, _pld);
+    GET(getPayload, payload *, pld);
+    GET(getPacketID, uint, p_id);
 
-    GET(getTriggerTime, uint, trigger_time);
+    SET(setSize, uint, size, _size);
+    GET(getSize, uint, size);
 
-    static void start_simulate(uint _end_time); // the function is used to start the simulation
+    static void discard(packet *&p)
+    {
+        // cout << "checking" << endl;
+        if (p != nullptr)
+        {
+            if (sim_metrics::isEnabled())
+                sim_metrics::mine().discarded++;
+            // cout << "discarding" << endl;
+            // cout << p->type() << endl;
+            delete p;
+            // cout << "discarded" << endl;
+        }
+        p = nullptr;
+        // cout << "checked" << endl;
+    }
+    virtual string type() = 0;
+    // you can define your own packet's addition_information
+    // to print more information for recv_event and send_event
+    virtual string addition_information() { return ""; }
 
-    static uint getCurTime() { return cur_time; }
-    static void getCurTime(uint _cur_time) { cur_time = _cur_time; }
-    // static uint getEndTime() { return end_time ; }
-    // static void getEndTime(uint _end_time) { end_time = _end_time; }
+    static int getLivePacketNum() { return live_packet_num; }
+    static uint getLastPacketID() { return last_packet_id; }
+    static void setLastPacketID(uint _last_packet_id) { last_packet_id = _last_packet_id; }
 
-    virtual void print() const = 0; // the function is used to print the event information
+    // save the packet (type, id, size, header and payload) for checkpointing
+    void save(snapshot_writer &w)
+    {
+        w.put_str(type());
+        w.put(p_id);
+        w.put(size);
+        hdr->save(w);
+        pld->save(w);
+    }
+    // rebuild a packet saved by save(); the packet keeps its original id
+    static packet *restore(snapshot_reader &r);
 
-    class event_generator
+    class packet_generator;
+    friend class packet_generator;
+    class packet_generator
     {
         // lock the copy constructor
-        event_generator(event_generator &) {}
-        // store all possible types of event
-        static map<string, event_generator *> prototypes;
+        packet_generator(packet_generator &) {}
+        // store all possible types of packet
+        static map<string, packet_generator *> prototypes;
 
     protected:
         // allow derived class to use it
-        event_generator() {}
-        // after you create a new event type, please register the factory of this event type by this function
-        void register_event_type(event_generator *h) { prototypes[h->type()] = h; }
-        // you have to implement your own generate() to generate your event
-        virtual event *generate(uint _trigger_time, void *data) = 0;
+        packet_generator() {}
+        // after you create a new packet type, please register the factory of this payload type by this function
+        void register_packet_type(packet_generator *h) { prototypes[h->type()] = h; }
+        // you have to implement your own generate() to generate your payload
+        virtual packet *generate(packet *p = nullptr) = 0;
 
     public:
-        // you have to implement your own type() to return your event type
+        // you have to implement your own type() to return your packet type
         virtual string type() = 0;
-        // this function is used to generate any type of event derived
-        static event *generate(string type, uint _trigger_time, void *data)
+        // this function is used to generate any type of packet derived
+        static packet *generate(string type)
         {
             if (prototypes.find(type) != prototypes.end())
             { // if this type derived exists
-                event *e = prototypes[type]->generate(_trigger_time, data);
-                add_event(e);
-                return e; // generate it!!
+                if (sim_metrics::isEnabled())
+                    sim_metrics::mine().generated++;
+                return prototypes[type]->generate(); // generate it!!
             }
-            std::cerr << "no such event type" << std::endl; // otherwise
+            std::cerr << "no such packet type" << std::endl; // otherwise
+            return nullptr;
+        }
+        static packet *replicate(packet *p)
+        {
+            if (prototypes.find(p->type()) != prototypes.end())
+            { // if this type derived exists
+                if (sim_metrics::isEnabled())
+                    sim_metrics::mine().replicated++;
+                return prototypes[p->type()]->generate(p); // generate it!!
+            }
+            std::cerr << "no such packet type" << std::endl; // otherwise
             return nullptr;
         }
         static void print()
         {
-            cout << "registered event types: " << endl;
-            for (map<string, event::event_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
+            cout << "registered packet types: " << endl;
+            for (map<string, packet::packet_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
                 cout << it->second->type() << endl;
         }
-        virtual ~event_generator() {}
+        virtual ~packet_generator() {};
     };
 };
-map<string, event::event_generator *> event::event_generator::prototypes;
-priority_queue<event *, vector<event *>, mycomp> event::events;
-hash<string> event::event_seq;
+map<string, packet::packet_generator *> packet::packet_generator::prototypes;
+uint packet::last_packet_id = 0;
+int packet::live_packet_num = 0;
 
-uint event::cur_time = 0;
-uint event::end_time = 0;
+packet *packet::restore(snapshot_reader &r)
+{
+    string type = r.get_str();
+    uint id = r.get<uint>();
+    double _size = r.get<double>();
+    if (!r.ok())
+        return nullptr;
+    uint next_id = last_packet_id;
+    packet *p = packet_generator::generate(type);
+    last_packet_id = next_id; // restored packets do not consume new ids
+    if (p == nullptr)
+        return nullptr;
+    p->p_id = id;
+    p->size = _size;
+    p->hdr->load(r);
+    p->pld->load(r);
+    return p;
+}
 
-void event::flush_events()
+// this packet is used to tell the destination the msg
+class TRA_data_packet : public packet
 {
-    cout << "**flush begin" << endl;
-    while (!events.empty())
+    TRA_data_packet(TRA_data_packet &) {}
+
+protected:
+    TRA_data_packet() {} // this constructor cannot be directly called by users
+    TRA_data_packet(packet *p) : packet(p->getHeader()->type(), p->getPayload()->type(), p->getSize(), true, p->getPacketID())
+    {
+        *(dynamic_cast<TRA_data_header *>(this->getHeader())) = *(dynamic_cast<TRA_data_header *>(p->getHeader()));
+        *(dynamic_cast<TRA_data_payload *>(this->getPayload())) = *(dynamic_cast<TRA_data_payload *>(p->getPayload()));
+        // DFS_path = (dynamic_cast<TRA_data_header*>(p))->DFS_path;
+        // isVisited = (dynamic_cast<TRA_data_header*>(p))->isVisited;
+    } // for duplicate
+    TRA_data_packet(string _h, string _p, double _size = 0) : packet(_h, _p, _size) {}
+
+public:
+    virtual ~TRA_data_packet() {}
+    string type() { return "TRA_data_packet"; }
+    virtual string addition_information()
+    {
+        double size = getSize();
+        // cout << counter << endl;
+        TRA_data_header *_hdr = dynamic_cast<TRA_data_header *>(getHeader());
+        uint label = 0;
+        if (_hdr && _hdr->get_num_labels())
+            return " label " + to_string(_hdr->get_label()); // " size " + to_string(size);
+        return " label x";
+    }
+
+    class TRA_data_packet_generator;
+    friend class TRA_data_packet_generator;
+    // TRA_data_packet is derived from packet_generator to generate a pub packet
+    class TRA_data_packet_generator : public packet_generator
+    {
+        static TRA_data_packet_generator sample;
+        // this constructor is only for sample to register this packet type
+        TRA_data_packet_generator() { /*cout << "TRA_data_packet registered" << endl;*/ register_packet_type(&sample); }
+
+    protected:
+        virtual packet *generate(packet *p = nullptr)
+        {
+            // cout << "TRA_data_packet generated" << endl;
+            if (nullptr == p)
+                return new TRA_data_packet("TRA_data_header", "TRA_data_payload"); // generate a new packet
+            else
+                return new TRA_data_packet(p); // duplicate
+        }
+
+    public:
+        virtual string type() { return "TRA_data_packet"; }
+        ~TRA_data_packet_generator() {}
+    };
+};
+TRA_data_packet::TRA_data_packet_generator TRA_data_packet::TRA_data_packet_generator::sample;
+
+// this packet type is used to tell the node what should be installed in the routing table
+class TRA_ctrl_packet : public packet
+{
+    TRA_ctrl_packet(TRA_ctrl_packet &) {}
+
+protected:
+    TRA_ctrl_packet() {} // this constructor cannot be directly called by users
+    TRA_ctrl_packet(packet *p) : packet(p->getHeader()->type(), p->getPayload()->type(), p->getSize(), true, p->getPacketID())
+    {
+        *(dynamic_cast<TRA_ctrl_header *>(this->getHeader())) = *(dynamic_cast<TRA_ctrl_header *>(p->getHeader()));
+        *(dynamic_cast<TRA_ctrl_payload *>(this->getPayload())) = *(dynamic_cast<TRA_ctrl_payload *>(p->getPayload()));
+        // DFS_path = (dynamic_cast<TRA_ctrl_header*>(p))->DFS_path;
+        // isVisited = (dynamic_cast<TRA_ctrl_header*>(p))->isVisited;
+    } // for duplicate
+    TRA_ctrl_packet(string _h, string _p, double _size = 0) : packet(_h, _p, _size) {}
+
+public:
+    virtual ~TRA_ctrl_packet() {}
+    string type() { return "TRA_ctrl_packet"; }
+    virtual string addition_information()
+    {
+        // uint counter = (dynamic_cast<TRA_ctrl_payload*>(this->getPayload()))->getCounter();
+        uint id = (dynamic_cast<TRA_ctrl_payload *>(this->getPayload()))->getnid();
+        // cout << counter << endl;
+        return " from " + to_string(id);
+    }
+
+    class TRA_ctrl_packet_generator;
+    friend class TRA_ctrl_packet_generator;
+    // TRA_ctrl_packet is derived from packet_generator to generate a pub packet
+    class TRA_ctrl_packet_generator : public packet_generator
+    {
+        static TRA_ctrl_packet_generator sample;
+        // this constructor is only for sample to register this packet type
+        TRA_ctrl_packet_generator() { /*cout << "TRA_ctrl_packet registered" << endl;*/ register_packet_type(&sample); }
+
+    protected:
+        virtual packet *generate(packet *p = nullptr)
+        {
+            // cout << "TRA_ctrl_packet generated" << endl;
+            if (nullptr == p)
+                return new TRA_ctrl_packet("TRA_ctrl_header", "TRA_ctrl_payload"); // generate a new packet
+            else
+                return new TRA_ctrl_packet(p); // duplicate
+        }
+
+    public:
+        virtual string type() { return "TRA_ctrl_packet"; }
+        ~TRA_ctrl_packet_generator() {}
+    };
+};
+TRA_ctrl_packet::TRA_ctrl_packet_generator TRA_ctrl_packet::TRA_ctrl_packet_generator::sample;
+
+class node
+{
+    // all nodes created in the program
+    static map<uint, node *> id_node_table;
+    map<uint, bool> phy_neighbors;
+    uint id;
+    uint num_of_label;
+
+protected:
+    node(node &) {} // this constructor should not be used
+    node() {}       // this constructor should not be used
+    node(uint _id) : id(_id) { id_node_table[_id] = this; }
+    virtual void print_to(ostream &os) const { os << id << endl; }
+
+public:
+    virtual ~node()
+    { // erase the node
+        id_node_table.erase(id);
+    }
+    MEM_ACCOUNTED(NODE)
+    friend ostream &operator<<(ostream &os, const node &n);
+
+    virtual string type() = 0; // please define it in your derived node class
+
+    void add_phy_neighbor(uint _id, string link_type = "simple_link", map<string, double> link_args = {}); // we only add a directed link from id to _id
+    void del_phy_neighbor(uint _id);                                                                       // we only delete a directed link from id to _id
+    // bulk version of add_phy_neighbor for an already checked list of neighbors in increasing order;
+    // the links are not created here, see link_generator::generate_all
+    void add_phy_neighbors(const uint *_ids, uint n);
+
+    // you can use the function to get the node's neigbhors at this time
+    const map<uint, bool> &getPhyNeighbors()
+    {
+        return phy_neighbors;
+    }
+
+    link *getLink(uint nb_id);
+
+    void recv(packet *p)
+    {
+        packet *tp = p;
+        if (sim_metrics::isEnabled() || node_profiler::isEnabled())
+        {
+            unsigned long long t0 = sim_metrics::now_ns(), c0 = node_profiler::ticks();
+            recv_handler(tp);
+            if (node_profiler::isEnabled())
+            {
+                node_profiler::profile &f = node_profiler::of(id);
+                f.recv_events++;
+                f.cycles += node_profiler::ticks() - c0;
+            }
+            if (sim_metrics::isEnabled())
+                sim_metrics::mine().recv_ns.record(sim_metrics::now_ns() - t0);
+        }
+        else
+            recv_handler(tp);
+        packet::discard(p);
+    } // the packet will be directly deleted after the handler
+    void send(packet *p);
+
+    // receive the packet and do something; this is a pure virtual function
+    virtual void recv_handler(packet *p) = 0;
+    void send_handler(packet *P);
+
+    // timers: timer_handler(timer_id) is called after delay; keep the handle if the timer may be cancelled
+    event_handle set_timer(uint delay, uint timer_id);
+    bool cancel_timer(event_handle h);
+    virtual void timer_handler(uint /*timer_id*/) {}
+
+    static node *id_to_node(uint _id)
+    {
+        map<uint, node *>::iterator it = id_node_table.find(_id);
+        return (it != id_node_table.end()) ? it->second : nullptr;
+    }
+    GET(getNodeID, uint, id);
+    GET(getNumOfLabel, uint, num_of_label);
+    SET(setNumOfLabel, uint, num_of_label, _num_of_label);
+
+    static void del_node(uint _id)
+    {
+        if (id_node_table.find(_id) != id_node_table.end())
+            id_node_table.erase(_id);
+    }
+    static uint getNodeNum() { return id_node_table.size(); }
+    static vector<uint> getNodeIDs()
+    {
+        vector<uint> ids;
+        for (map<uint, node *>::iterator it = id_node_table.begin(); it != id_node_table.end(); it++)
+            ids.push_back(it->first);
+        return ids;
+    }
+
+    // save/load the node's own state (e.g., its routing tables) for checkpointing
+    // the topology itself is not saved; it is rebuilt from the input before restoring
+    virtual void save(snapshot_writer & /*w*/) const {}
+    virtual void load(snapshot_reader & /*r*/) {}
+    static void save_all(snapshot_writer &w);
+    static bool load_all(snapshot_reader &r);
+
+    class node_generator
+    {
+        // lock the copy constructor
+        node_generator(node_generator &) {}
+        // store all possible types of node
+        static map<string, node_generator *> prototypes;
+
+    protected:
+        // allow derived class to use it
+        node_generator() {}
+        // after you create a new node type, please register the factory of this node type by this function
+        void register_node_type(node_generator *h) { prototypes[h->type()] = h; }
+        // you have to implement your own generate() to generate your node
+        virtual node *generate(uint _id) = 0;
+
+    public:
+        // you have to implement your own type() to return your node type
+        virtual string type() = 0;
+        // this function is used to generate any type of node derived
+        static node *generate(string type, uint _id)
+        {
+            if (id_node_table.find(_id) != id_node_table.end())
+            {
+                std::cerr << "duplicate node id" << std::endl; // node id is duplicated
+                return nullptr;
+            }
+            else if (BROCAST_ID == _id)
+            {
+                cerr << "BROCAST_ID cannot be used" << endl;
+                return nullptr;
+            }
+            else if (prototypes.find(type) != prototypes.end())
+            { // if this type derived exists
+                node *created_node = prototypes[type]->generate(_id);
+                return created_node; // generate it!!
+            }
+            std::cerr << "no such node type" << std::endl; // otherwise
+            return nullptr;
+        }
+        static void print()
+        {
+            cout << "registered node types: " << endl;
+            for (map<string, node::node_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
+                cout << it->second->type() << endl;
+        }
+        virtual ~node_generator() {};
+    };
+};
+map<string, node::node_generator *> node::node_generator::prototypes;
+map<uint, node *> node::id_node_table;
+
+void node::save_all(snapshot_writer &w)
+{
+    w.put<uint>(id_node_table.size());
+    for (map<uint, node *>::iterator it = id_node_table.begin(); it != id_node_table.end(); it++)
+    {
+        w.put(it->first);
+        it->second->save(w);
+    }
+}
+bool node::load_all(snapshot_reader &r)
+{
+    uint n = r.get<uint>();
+    if (n != id_node_table.size())
+    {
+        cerr << "snapshot error: the snapshot has " << n << " nodes but the topology has " << id_node_table.size() << endl;
+        return false;
+    }
+    for (; n > 0 && r.ok(); n--)
+    {
+        node *nd = id_to_node(r.get<uint>());
+        if (nd == nullptr)
+        {
+            cerr << "snapshot error: no such node" << endl;
+            return false;
+        }
+        nd->load(r);
+    }
+    return r.ok();
+}
+
+// link_state_db is the link-state database shared by all the TRA_switches
+// the adjacencies of one origin are kept in an immutable block, and switches that learned the same adjacencies of an origin
+// share one block; a switch only holds the id of the block it has learned for each origin, and a new block (a new version)
+// is interned whenever what it learned about the origin changes
+class link_state_db
+{
+public:
+    class adjacency
+    {
+    public:
+        uint nb_id;
+        float capacity; // capacities are stored in single precision
+        float occupied;
+        bool operator==(const adjacency &a) const { return nb_id == a.nb_id && capacity == a.capacity && occupied == a.occupied; }
+    };
+    static const uint NO_BLOCK = UINT_MAX;
+
+    // return the block that results from overwriting the adjacencies of block base (NO_BLOCK for an empty one) with updates;
+    // the caller owns one reference to the returned block
+    static uint apply(uint origin, uint base, const map<uint, pair<double, double>> &updates);
+    static void release(uint id);
+    // apply and release may run on several threads; lookups must not run concurrently with them
+    static bool find(uint id, uint nb_id, pair<double, double> &state);
+    static const vector<adjacency> &adjacencies(uint id) { return blocks[id].adj; }
+    static pair<double, double> quantize(const pair<double, double> &state) { return {float(state.first), float(state.second)}; }
+    static uint getBlockNum() { return blocks.size() - free_ids.size(); }
+    static unsigned long long getBytes(); // an estimate of the heap memory of the blocks and the index
+
+private:
+    class block
+    {
+    public:
+        uint origin;
+        uint refs;
+        unsigned long long hash;
+        vector<adjacency> adj; // sorted by nb_id
+    };
+    static vector<block> blocks;
+    static vector<uint> free_ids;
+    static unordered_multimap<unsigned long long, uint> index; // hash -> block id
+    static mutex lock;
+};
+vector<link_state_db::block> link_state_db::blocks;
+vector<uint> link_state_db::free_ids;
+unordered_multimap<unsigned long long, uint> link_state_db::index;
+mutex link_state_db::lock;
+
+unsigned long long link_state_db::getBytes()
+{
+    unsigned long long total = blocks.capacity() * sizeof(block) + free_ids.capacity() * sizeof(uint);
+    for (const block &b : blocks)
+        total += b.adj.capacity() * sizeof(adjacency);
+    total += index.bucket_count() * sizeof(void *) + index.size() * (sizeof(pair<unsigned long long, uint>) + 2 * sizeof(void *));
+    return total;
+}
+
+uint link_state_db::apply(uint origin, uint base, const map<uint, pair<double, double>> &updates)
+{
+    lock_guard<mutex> guard(lock);
+    vector<adjacency> adj;
+    const vector<adjacency> empty;
+    const vector<adjacency> &old = (base == NO_BLOCK) ? empty : blocks[base].adj;
+    adj.reserve(old.size() + updates.size());
+    auto it = old.begin();
+    for (auto up = updates.begin(); up != updates.end(); up++)
+    {
+        for (; it != old.end() && it->nb_id < up->first; it++)
+            adj.push_back(*it);
+        if (it != old.end() && it->nb_id == up->first)
+            it++;
+        adj.push_back({up->first, float(up->second.first), float(up->second.second)});
+    }
+    adj.insert(adj.end(), it, old.end());
+
+    fnv_hash h;
+    h.add(origin);
+    for (const adjacency &a : adj)
+    {
+        h.add(a.nb_id);
+        h.add(a.capacity);
+        h.add(a.occupied);
+    }
+    auto range = index.equal_range(h.value());
+    for (auto cand = range.first; cand != range.second; cand++)
+    {
+        block &b = blocks[cand->second];
+        if (b.origin == origin && b.adj == adj)
+        {
+            b.refs++;
+            return cand->second;
+        }
+    }
+
+    uint id;
+    if (free_ids.empty())
+    {
+        id = blocks.size();
+        blocks.push_back(block());
+    }
+    else
+    {
+        id = free_ids.back();
+        free_ids.pop_back();
+    }
+    blocks[id].origin = origin;
+    blocks[id].refs = 1;
+    blocks[id].hash = h.value();
+    blocks[id].adj.swap(adj);
+    index.insert({h.value(), id});
+    return id;
+}
+
+void link_state_db::release(uint id)
+{
+    if (id == NO_BLOCK)
+        return;
+    lock_guard<mutex> guard(lock);
+    block &b = blocks[id];
+    if (--b.refs > 0)
+        return;
+    auto range = index.equal_range(b.hash);
+    for (auto cand = range.first; cand != range.second; cand++)
+        if (cand->second == id)
+        {
+            index.erase(cand);
+            break;
+        }
+    vector<adjacency>().swap(b.adj);
+    free_ids.push_back(id);
+}
+
+bool link_state_db::find(uint id, uint nb_id, pair<double, double> &state)
+{
+    if (id == NO_BLOCK)
+        return false;
+    const vector<adjacency> &adj = blocks[id].adj;
+    auto it = lower_bound(adj.begin(), adj.end(), nb_id, [](const adjacency &a, uint n)
+                          { return a.nb_id < n; });
+    if (it == adj.end() || it->nb_id != nb_id)
+        return false;
+    state = {it->capacity, it->occupied};
+    return true;
+}
+
+class TRA_switch : public node
+{
+    // you can extract the data structure for storing nodes and links here from hw1
+    // note the data stored here should be local and cannot be accessed by the other nodes directly
+
+    // what this switch keeps about each origin of TRA_ctrl_packets, in a flat array indexed by the origin's node id
+    class origin_state
+    {
+    public:
+        bool heard = false; // whether last_p_id is set
+        uint last_p_id = 0;
+        vector<uint> entries;                       // the neighbors that relayed the origin's floods, in arrival order
+        unsigned long long entry_bits = 0;          // entries as a bitset over neighbor slots 0-63
+        vector<unsigned long long> more_entry_bits; // and over neighbor slots 64 and above
+        uint block = link_state_db::NO_BLOCK;       // the link_state_db block of what this switch learned about the origin's adjacencies
+        bool seq_heard = false;                     // whether last_seq is set
+        uint last_seq = 0;
+        bool stale = false;    // a delta LSA was lost; ignore the deltas until the next full LSA
+        uint dist = UINT_MAX;  // the origin's node in the shortest-path tree: hops from this switch,
+        uint parent = UINT_MAX; // the predecessor (the smallest id among the equally short ones),
+        uint hop = UINT_MAX;    // and the first hop towards it
+    };
+    vector<origin_state> origins;
+    uint n_entry_origins = 0;           // the number of origins with entries
+    unordered_map<uint, uint> nb_slots; // neighbor id -> its bit in origin_state::entry_bits
+    origin_state &getOriginState(uint src_id)
+    {
+        if (src_id >= origins.size())
+            origins.resize(src_id + 1);
+        return origins[src_id];
+    }
+    uint neighbor_slot(uint nb_id); // UINT_MAX if nb_id is not a neighbor
+    // append nb_id to o's entries unless it is there; return false if it is
+    bool add_entry(origin_state &o, uint nb_id);
+    void set_entries(origin_state &o, const vector<uint> &entries);
+
+    // delta LSAs: with lsa_refresh = k > 0, only every k-th LSA of this switch is full and the others carry the
+    // changed adjacencies; a receiver ignores the deltas of an origin after a sequence gap until its next full LSA
+    uint lsa_refresh = 0; // 0: every LSA is full
+    uint lsa_seq = 0;
+    bool accept_lsa(uint src_id, TRA_ctrl_payload *l3);
+
+    // shortest-path routing: with spf_routing, a switch keeps a shortest-path tree (in hops) over the links it has learned,
+    // rooted at itself, and forwards along it instead of towards the first relay of the destination's flood;
+    // the tree is updated incrementally (Ramalingam-Reps) when the learned links of an origin change
+    bool spf_routing = false;
+    typedef priority_queue<pair<uint, uint>, vector<pair<uint, uint>>, greater<pair<uint, uint>>> spf_queue; // (dist, node id)
+    bool spf_link(uint u, uint v) const;
+    void spf_offer(uint u, uint v, spf_queue &q);
+    void spf_settle(spf_queue &q);
+    void spf_update(uint src_id, uint old_block);
+    void spf_rebuild();
+    uint next_hop(uint dst_id) const; // UINT_MAX if dst_id is unknown
+
+    // next hops precomputed offline by apsp_engine (--load-routes); the row of destination d is
+    // preset_routes[d * preset_width, (d + 1) * preset_width): the next hop, then the alternates, UINT_MAX for none
+    vector<uint> preset_routes;
+    uint preset_width = 0;
+
+    // the forwarding table compiled from the state above, indexed by destination id; it is rebuilt before forwarding
+    // a TRA_data_packet if the state changed since
+    class fib_entry
+    {
+    public:
+        uint next_hop = UINT_MAX;
+        uint slot = 0;      // the residual capacity towards next_hop is residual[slot]
+        uint alt_begin = 0; // the alternates tried when next_hop lacks capacity are fib_alts[alt_begin, alt_end)
+        uint alt_end = 0;
+    };
+    vector<fib_entry> fib;
+    vector<pair<uint, uint>> fib_alts; // (neighbor id, residual slot)
+    vector<double> residual;           // learned capacity - occupied per neighbor slot; the last slot is for unknown links
+    bool residual_live = false;        // this switch has not advertised its links, so residual is read from the links instead
+    // the room towards nb_id in residual slot slot
+    double room(uint slot, uint nb_id) { return (residual_live && nb_id != UINT_MAX) ? getCapacity(nb_id) - getOccupied(nb_id) : residual[slot]; }
+    // whether the link has room for size by the rule of simple_link::canTransmit, i.e., occupied + size <= capacity
+    bool fits(uint slot, uint nb_id, double size) { return room(slot, nb_id) >= size; }
+    bool fib_dirty = true;
+    uint route_version = 0; // bumped on every rebuild of the forwarding table
+    void build_fib();
+    // the branch of route_data that chose a route; it tells which other sizes the route holds for
+    enum route_choice
+    {
+        ROUTE_UNKNOWN, // the destination is unknown, for any size
+        ROUTE_PRIMARY, // the next hop has room for the packet
+        ROUTE_CSPF,    // the next hop has no room, and the cached CSPF route of the size class is taken
+        ROUTE_OTHER    // depends on the exact size
+    };
+    // the sizes are grouped into classes of powers of two: class c holds (2^(c-1), 2^c]; SIZE_CLASSES - 1 is above 2^32
+    static const uint SIZE_CLASSES = 34;
+    static uint size_class(double size)
+    {
+        uint c = 0;
+        while (c < SIZE_CLASSES - 1 && double(1ULL << c) < size)
+            c++;
+        return c;
+    }
+
+    // choose where a data packet goes next and push the labels it needs; UINT_MAX drops it
+    // choice, if given, gets the branch that made the decision
+    uint route_data(TRA_data_header *h4, double size, route_choice *choice = nullptr);
+
+    // the routing decision a source makes for a new data packet only depends on its destination and size;
+    // it is cached per destination and size class until the forwarding table is rebuilt, and a hit is taken
+    // only if the branch that chose the route still chooses it for the packet's size
+    class source_route
+    {
+    public:
+        uint version = 0; // route_version when it was computed; 0 for none
+        route_choice choice = ROUTE_OTHER;
+        uint next_id = UINT_MAX;
+        vector<uint> labels; // pushed on top of the destination
+    };
+    class source_route_hash
+    {
+    public:
+        size_t operator()(const pair<uint, uint> &key) const { return (size_t(key.first) * SIZE_CLASSES + key.second) * 0x9E3779B97F4A7C15ULL; }
+    };
+    unordered_map<pair<uint, uint>, source_route, source_route_hash> source_routes; // (dst, size class) -> route
+    unsigned long long path_cache_hits = 0;
+    unsigned long long path_cache_misses = 0;
+    unsigned long long path_cache_invalidations = 0; // misses on a route computed for an older forwarding table
+    uint route_from_source(TRA_data_header *h4, double size);
+
+    // constrained shortest paths: with cspf_routing, a data packet that does not fit its next link gets the fewest labels
+    // that steer it along a hop-shortest path whose links all have room for it; each segment between two labels is the
+    // unique shortest path between its ends, so the switches' default forwarding follows it
+    bool cspf_routing = false;
+    uint link_state_version = 1; // bumped whenever a learned block changes
+    class cspf_route
+    {
+    public:
+        vector<uint> path;   // from this switch to the destination; empty if there is none
+        vector<uint> labels; // the waypoints, in path order
+    };
+    map<pair<uint, uint>, cspf_route> cspf_cache; // (destination, size class) -> route, for cspf_cache_version
+    uint cspf_cache_version = 0;
+    cspf_route cspf_scratch; // a route that cannot be cached
+    friend class microbench; // it clears the caches between batches
+    // h, if given, excludes the switches the packet has visited
+    void cspf_compute(uint dst_id, double size, TRA_data_header *h, cspf_route &route);
+    const cspf_route *cspf_find(uint dst_id, double size, TRA_data_header *h); // nullptr if there is no route
+    bool cspf_fits(const vector<uint> &labels, TRA_data_header *h);          // whether pushing labels keeps h within the label budget
+    // the size a data packet is routed by: the truncated one the links reserve, or with cspf_routing the exact one
+    double route_size(TRA_data_packet *p) { return cspf_routing ? dynamic_cast<TRA_data_header *>(p->getHeader())->getFlowSize() : p->getSize(); }
+
+protected:
+    TRA_switch() {}                     // it should not be used
+    TRA_switch(TRA_switch &) {}         // it should not be used
+    TRA_switch(uint _id) : node(_id) {} // this constructor cannot be directly called by users
+    virtual void print_to(ostream &os) const override;
+
+public:
+    ~TRA_switch()
+    {
+        for (origin_state &o : origins)
+            link_state_db::release(o.block);
+    }
+    string type() { return "TRA_switch"; }
+
+    // please define recv_handler function to deal with the incoming packet
+    bool isNewPacket(packet *p);
+    virtual void recv_handler(packet *p);
+
+    SET(setLSARefresh, uint, lsa_refresh, _lsa_refresh);
+    GET(getLSARefresh, uint, lsa_refresh);
+    SET(setSPFRouting, bool, spf_routing, _spf_routing);
+    GET(getSPFRouting, bool, spf_routing);
+    SET(setCSPFRouting, bool, cspf_routing, _cspf_routing);
+    GET(getCSPFRouting, bool, cspf_routing);
+    GET(getPathCacheHits, unsigned long long, path_cache_hits);
+    GET(getPathCacheMisses, unsigned long long, path_cache_misses);
+    GET(getPathCacheInvalidations, unsigned long long, path_cache_invalidations);
+
+    virtual void save(snapshot_writer &w) const;
+    virtual void load(snapshot_reader &r);
+
+    // install what this switch learns from the flood of src_id's TRA_ctrl_packet p_id
+    // entries are the neighbors that relay the flood to this switch, in arrival order
+    void install_origin(uint src_id, uint p_id, const vector<uint> &entries, const map<uint, pair<double, double>> &src_nbs);
+    // compute and install the state that one round of TRA_ctrl_packet floods at time t converges to, without simulating it
+    static void fast_forward_control_plane(uint t, uint num_threads);
+    // load the next-hop tables written by apsp_engine::write into every switch
+    static bool load_routes(const string &path);
+    // the source path cache counters summed over all switches
+    static void path_cache_totals(unsigned long long &hits, unsigned long long &misses, unsigned long long &invalidations);
+    static void print_path_cache_stats(ostream &os);
+    // add an estimate of the heap memory of this switch's tables to bytes, by table
+    void table_bytes(map<string, unsigned long long> &bytes) const;
+
+    double getCapacity(uint nb_id);
+    double getOccupied(uint nb_id);
+
+    // overwrite what this switch knows about src_id's adjacencies with updates; the shortest-path tree is left for
+    // the caller to rebuild if update_spf is false
+    void learn(uint src_id, const map<uint, pair<double, double>> &updates, bool update_spf = true);
+    // the (capacity, occupied) of link (src_id, nb_id) this switch learned; the second form throws out_of_range if unknown
+    bool findLinkState(uint src_id, uint nb_id, pair<double, double> &state) const;
+    pair<double, double> getLinkState(uint src_id, uint nb_id) const;
+
+    // void add_one_hop_neighbor (uint n_id) { one_hop_neighbors[n_id] = true; }
+    // uint get_one_hop_neighbor_num () { return one_hop_neighbors.size(); }
+
+    class TRA_switch_generator;
+    friend class TRA_switch_generator;
+    // TRA_switch is derived from node_generator to generate a node
+    class TRA_switch_generator : public node_generator
+    {
+        static TRA_switch_generator sample;
+        // this constructor is only for sample to register this node type
+        TRA_switch_generator() { /*cout << "TRA_switch registered" << endl;*/ register_node_type(&sample); }
+
+    protected:
+        virtual node *generate(uint _id) { /*cout << "TRA_switch generated" << endl;*/ return new TRA_switch(_id); }
+
+    public:
+        virtual string type() { return "TRA_switch"; }
+        ~TRA_switch_generator() {}
+    };
+};
+TRA_switch::TRA_switch_generator TRA_switch::TRA_switch_generator::sample;
+
+// timer_wheel is a hierarchical timing wheel that keeps timer events out of the event heap until they are due
+// level k has 64 slots of 64^k time units; a timer goes to the level of the highest 6-bit group in which its
+// trigger time differs from now, so schedule and cancel are O(1); timers beyond 64^4 wait in an overflow list
+class timer_wheel
+{
+    static const uint LEVELS = 4;
+    static const uint SLOT_BITS = 6;
+    static const uint SLOTS = 1 << SLOT_BITS;
+    static const uint OVERFLOW_LIST = LEVELS * SLOTS;
+    static const uint RELEASED = OVERFLOW_LIST + 1; // the timer has been handed to the event heap
+    static const uint FREE = OVERFLOW_LIST + 2;
+    static const uint NIL = UINT_MAX;
+
+    class timer_entry
+    {
+    public:
+        event *e = nullptr;
+        uint time = 0;
+        uint list = FREE; // level * SLOTS + slot, OVERFLOW_LIST, RELEASED or FREE
+        uint prev = NIL;
+        uint next = NIL;
+        uint gen = 0;
+    };
+    vector<timer_entry> entries;
+    vector<uint> free_entries;
+    uint heads[OVERFLOW_LIST + 1];
+    unsigned long long occupied[LEVELS]; // bit s of occupied[k] is set if slot s of level k is not empty
+    unsigned long long now = 0;          // every timer in the wheel triggers at or after now
+    uint pending = 0;
+
+    timer_wheel(timer_wheel &) {}
+
+    void link_entry(uint i, uint list)
+    {
+        timer_entry &t = entries[i];
+        t.list = list;
+        t.prev = NIL;
+        t.next = heads[list];
+        if (t.next != NIL)
+            entries[t.next].prev = i;
+        heads[list] = i;
+        if (list < OVERFLOW_LIST)
+            occupied[list / SLOTS] |= 1ULL << (list % SLOTS);
+    }
+    void unlink_entry(uint i)
+    {
+        timer_entry &t = entries[i];
+        if (t.prev != NIL)
+            entries[t.prev].next = t.next;
+        else
+            heads[t.list] = t.next;
+        if (t.next != NIL)
+            entries[t.next].prev = t.prev;
+        if (t.list < OVERFLOW_LIST && heads[t.list] == NIL)
+            occupied[t.list / SLOTS] &= ~(1ULL << (t.list % SLOTS));
+        t.prev = t.next = NIL;
+    }
+    // the timer must not trigger before now
+    void place(uint i)
+    {
+        unsigned long long diff = entries[i].time ^ now;
+        uint level = 0;
+        while (level < LEVELS && (diff >> ((level + 1) * SLOT_BITS)) != 0)
+            level++;
+        if (level == LEVELS)
+            link_entry(i, OVERFLOW_LIST);
+        else
+            link_entry(i, level * SLOTS + ((entries[i].time >> (level * SLOT_BITS)) & (SLOTS - 1)));
+    }
+    void cascade(uint list)
+    {
+        uint i = heads[list];
+        heads[list] = NIL;
+        if (list < OVERFLOW_LIST)
+            occupied[list / SLOTS] &= ~(1ULL << (list % SLOTS));
+        while (i != NIL)
+        {
+            uint next = entries[i].next;
+            place(i);
+            i = next;
+        }
+    }
+    // the earliest time at which a timer may be due; no timer triggers before it
+    unsigned long long next_time() const
+    {
+        for (uint k = 0; k < LEVELS; k++)
+        {
+            uint shift = k * SLOT_BITS;
+            uint idx = (now >> shift) & (SLOTS - 1);
+            // the current slot of a level above 0 is always empty because it was cascaded when now entered it
+            unsigned long long bits = (k == 0) ? (occupied[0] & (~0ULL << idx)) : (idx == SLOTS - 1 ? 0 : occupied[k] & (~0ULL << (idx + 1)));
+            if (bits != 0)
+                return ((now >> (shift + SLOT_BITS)) << (shift + SLOT_BITS)) + ((unsigned long long)__builtin_ctzll(bits) << shift);
+        }
+        return ((now >> (LEVELS * SLOT_BITS)) + 1) << (LEVELS * SLOT_BITS);
+    }
+    // move now forward and cascade every slot that now enters, from the top level down
+    void move_to(unsigned long long to)
+    {
+        unsigned long long from = now;
+        now = to;
+        if ((from >> (LEVELS * SLOT_BITS)) != (to >> (LEVELS * SLOT_BITS)))
+            cascade(OVERFLOW_LIST);
+        for (uint k = LEVELS - 1; k >= 1; k--)
+            if ((from >> (k * SLOT_BITS)) != (to >> (k * SLOT_BITS)))
+                cascade(k * SLOTS + ((to >> (k * SLOT_BITS)) & (SLOTS - 1)));
+    }
+
+public:
+    timer_wheel()
+    {
+        for (uint i = 0; i <= OVERFLOW_LIST; i++)
+            heads[i] = NIL;
+        for (uint k = 0; k < LEVELS; k++)
+            occupied[k] = 0;
+    }
+
+    // add e, which triggers at time; due is set if the time has already been passed and e should go to the event heap
+    timer_handle schedule(event *e, uint time, bool &due)
+    {
+        uint i;
+        if (!free_entries.empty())
+        {
+            i = free_entries.back();
+            free_entries.pop_back();
+        }
+        else
+        {
+            i = entries.size();
+            entries.push_back(timer_entry());
+        }
+        entries[i].e = e;
+        entries[i].time = time;
+        due = (time < now);
+        if (due)
+            entries[i].list = RELEASED;
+        else
+        {
+            place(i);
+            pending++;
+        }
+        timer_handle h;
+        h.slot = i;
+        h.gen = entries[i].gen;
+        return h;
+    }
+
+    // remove the timer from the wheel and return its event; released is set if the event is already in the event heap
+    // nullptr is returned if the handle is stale
+    event *cancel(timer_handle h, bool &released)
+    {
+        released = false;
+        if (!h.valid() || h.slot >= entries.size() || entries[h.slot].gen != h.gen || entries[h.slot].list == FREE)
+            return nullptr;
+        timer_entry &t = entries[h.slot];
+        if (t.list == RELEASED)
+        {
+            released = true;
+            return t.e;
+        }
+        unlink_entry(h.slot);
+        pending--;
+        t.list = RELEASED; // the caller deletes the event, which retires the entry
+        return t.e;
+    }
+
+    // the event of the timer is deleted; its entry can be reused
+    void retire(timer_handle h)
+    {
+        if (!h.valid() || h.slot >= entries.size() || entries[h.slot].gen != h.gen)
+            return;
+        timer_entry &t = entries[h.slot];
+        if (t.list != RELEASED && t.list != FREE)
+        {
+            unlink_entry(h.slot);
+            pending--;
+        }
+        t.list = FREE;
+        t.e = nullptr;
+        t.gen++;
+        free_entries.push_back(h.slot);
+    }
+
+    // hand every timer that triggers at or before bound to due
+    // with first_only, only the earliest timers (all triggering at the same time) are handed over
+    void release(uint bound, vector<event *> &due, bool first_only = false)
+    {
+        while (pending > 0)
+        {
+            unsigned long long t = next_time();
+            if (t > bound)
+                break;
+            move_to(t);
+            uint list = now & (SLOTS - 1); // the current slot of level 0 holds the timers triggering at now
+            for (uint i = heads[list]; i != NIL; i = heads[list])
+            {
+                unlink_entry(i);
+                entries[i].list = RELEASED;
+                pending--;
+                due.push_back(entries[i].e);
+            }
+            if (first_only && !due.empty())
+                break;
+        }
+    }
+
+    // the events still waiting in the wheel, in a deterministic order (for checkpointing)
+    vector<event *> waiting() const
+    {
+        vector<event *> es;
+        for (const timer_entry &t : entries)
+            if (t.list < RELEASED)
+                es.push_back(t.e);
+        return es;
+    }
+    GET(size, uint, pending);
+};
+
+class mycomp
+{
+    bool reverse;
+
+public:
+    mycomp(const bool &revparam = false) { reverse = revparam; }
+    bool operator()(const event *lhs, const event *rhs) const;
+};
+
+class event
+{
+    event(event *&) {} // this constructor cannot be directly called by users
+    // the underlying heap is exposed so that a checkpoint can store it in its exact order
+    class event_queue : public priority_queue<event *, vector<event *>, mycomp>
+    {
+    public:
+        vector<event *> &container() { return c; }
+    };
+    static event_queue events;
+    static uint cur_time; // timer
+    static unsigned long long next_seq;
+    static uint end_time;
+
+    // periodic checkpoint; disabled when checkpoint_interval is zero
+    static string checkpoint_path;
+    static uint checkpoint_interval;
+
+    friend class microbench;     // it drives the event queue directly
+    friend class mem_accounting; // it lists the pending events
+
+    // get the next event
+    static event *get_next_event();
+    static void add_event(event *e)
+    {
+        if (!e->use_timer_wheel())
+        {
+            events.push(e);
+            return;
+        }
+        bool due;
+        e->wheel_handle = timers.schedule(e, e->trigger_time, due);
+        if (due)
+            events.push(e);
+    }
+    // timer events wait here until they are due and are then merged into events
+    static timer_wheel timers;
+
+    // every pending event has a slot here, so an event_handle can find it in O(1)
+    static vector<event *> registry;
+    static vector<uint> registry_gen;
+    static vector<uint> registry_free;
+    uint reg_slot = UINT_MAX;
+    void enroll()
+    {
+        if (!registry_free.empty())
+        {
+            reg_slot = registry_free.back();
+            registry_free.pop_back();
+        }
+        else
+        {
+            reg_slot = registry.size();
+            registry.push_back(nullptr);
+            registry_gen.push_back(0);
+        }
+        registry[reg_slot] = this;
+    }
+    void withdraw()
+    {
+        if (reg_slot == UINT_MAX)
+            return;
+        registry[reg_slot] = nullptr;
+        registry_gen[reg_slot]++;
+        registry_free.push_back(reg_slot);
+        reg_slot = UINT_MAX;
+    }
+
+    // cancelled events stay in the heap as tombstones; the heap is compacted when they make up most of it
+    static uint tombstones;
+    static const uint COMPACT_MIN_TOMBSTONES = 1024;
+    static void compact_events();
+    static hash<string> event_seq;
+
+    // with stable_order, the order of creation breaks ties of (trigger_time, priority), so the order of the events does
+    // not depend on when they entered the heap, e.g., through the timer wheel; without it, ties are popped in heap order
+    // as in the original scheduler
+    static bool stable_order;
+    unsigned long long seq = 0;
+
+protected:
+    uint trigger_time;
+    timer_handle wheel_handle; // valid if the event was scheduled in the timer wheel
+    bool cancelled = false;    // a cancelled event is dropped without being printed or triggered
+
+    event() {} // it should not be used
+    event(uint _trigger_time) : seq(next_seq++), trigger_time(_trigger_time) { enroll(); }
+
+    // an event returning true is kept in the timer wheel instead of the event heap until it is due
+    virtual bool use_timer_wheel() const { return false; }
+
+public:
+    virtual void trigger() = 0;
+    virtual ~event()
+    {
+        timers.retire(wheel_handle);
+        withdraw();
+    }
+    MEM_ACCOUNTED(EVENT)
+    // the packets this event still owns; they are freed with it
+    virtual uint held_packets() const { return 0; }
+
+    event_handle getHandle() const
+    {
+        event_handle h;
+        if (reg_slot != UINT_MAX)
+        {
+            h.slot = reg_slot;
+            h.gen = registry_gen[reg_slot];
+        }
+        return h;
+    }
+    // the pending event of the handle, or nullptr if it has fired or been cancelled
+    static event *find(event_handle h)
+    {
+        if (!h.valid() || h.slot >= registry.size() || registry_gen[h.slot] != h.gen)
+            return nullptr;
+        return registry[h.slot];
+    }
+    // cancel a pending event; false if it has already fired or been cancelled
+    // a cancelled event is never printed or triggered
+    static bool cancel(event_handle h);
+
+    virtual string type() = 0; // please return the same name as the event's generator
+
+    // save the event's own fields for checkpointing; the type and trigger_time are saved by the caller
+    // the generator of the event type reads them back in its restore()
+    virtual void save(snapshot_writer &w) const = 0;
+
+    virtual uint event_priority() const = 0;
+    static uint get_hash_value(string string_for_hash)
+    {
+        uint priority = event_seq(string_for_hash);
+        return priority;
+    }
+
+    static void flush_events(); // only for debug
+
+    GET(getTriggerTime, uint, trigger_time);
+    GET(getSeq, unsigned long long, seq);
+    static void setStableOrder(bool _stable_order) { stable_order = _stable_order; }
+    static bool isStableOrder() { return stable_order; }
+
+    static void start_simulate(uint _end_time); // the function is used to start the simulation
+
+    // write a snapshot every _interval time units to _path (0 disables it)
+    static void setCheckpoint(string _path, uint _interval)
+    {
+        checkpoint_path = _path;
+        checkpoint_interval = _interval;
+    }
+    // the snapshot holds cur_time, last_packet_id, every node's and link's state and all pending events
+    // restore() expects the same topology to be built already and the event queue to be empty
+    static bool checkpoint(const string &path);
+    static bool restore(const string &path);
+
+    static uint getCurTime() { return cur_time; }
+    static void getCurTime(uint _cur_time) { cur_time = _cur_time; }
+    // static uint getEndTime() { return end_time ; }
+    // static void getEndTime(uint _end_time) { end_time = _end_time; }
+
+    virtual void print() const = 0; // the function is used to print the event information
+
+    class event_generator
+    {
+        // lock the copy constructor
+        event_generator(event_generator &) {}
+        // store all possible types of event
+        static map<string, event_generator *> prototypes;
+
+    protected:
+        // allow derived class to use it
+        event_generator() {}
+        // after you create a new event type, please register the factory of this event type by this function
+        void register_event_type(event_generator *h) { prototypes[h->type()] = h; }
+        // you have to implement your own generate() to generate your event
+        virtual event *generate(uint _trigger_time, void *data) = 0;
+        // you have to implement your own restore() to read back the fields written by your event's save()
+        virtual event *restore(uint _trigger_time, snapshot_reader &r) = 0;
+
+    public:
+        // you have to implement your own type() to return your event type
+        virtual string type() = 0;
+        // this function is used to generate any type of event derived
+        // the returned handle can be used to cancel the event; it is invalid if no event is generated
+        static event_handle generate(string type, uint _trigger_time, void *data)
+        {
+            event *e = generate_event(type, _trigger_time, data);
+            return (e != nullptr) ? e->getHandle() : event_handle();
+        }
+        // the same, returning the event itself for node::send, which keeps the framework's call shape;
+        // the pointer is only valid until the event fires or is cancelled
+        static event *generate_event(string type, uint _trigger_time, void *data)
+        {
+            if (prototypes.find(type) != prototypes.end())
+            { // if this type derived exists
+                event *e = prototypes[type]->generate(_trigger_time, data);
+                add_event(e);
+                return e; // generate it!!
+            }
+            std::cerr << "no such event type" << std::endl; // otherwise
+            return nullptr;
+        }
+        // this function is used to rebuild an event saved in a snapshot; the event is not added to the queue
+        static event *restore(snapshot_reader &r)
+        {
+            string type = r.get_str();
+            uint _trigger_time = r.get<uint>();
+            if (!r.ok())
+                return nullptr;
+            if (prototypes.find(type) != prototypes.end())
+                return prototypes[type]->restore(_trigger_time, r);
+            std::cerr << "no such event type" << std::endl; // otherwise
+            return nullptr;
+        }
+        static void print()
+        {
+            cout << "registered event types: " << endl;
+            for (map<string, event::event_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
+                cout << it->second->type() << endl;
+        }
+        virtual ~event_generator() {}
+    };
+};
+map<string, event::event_generator *> event::event_generator::prototypes;
+event::event_queue event::events;
+timer_wheel event::timers;
+vector<event *> event::registry;
+vector<uint> event::registry_gen;
+vector<uint> event::registry_free;
+uint event::tombstones = 0;
+hash<string> event::event_seq;
+
+uint event::cur_time = 0;
+unsigned long long event::next_seq = 0;
+bool event::stable_order = false;
+uint event::end_time = 0;
+string event::checkpoint_path;
+uint event::checkpoint_interval = 0;
+
+bool event::cancel(event_handle h)
+{
+    event *e = find(h);
+    if (e == nullptr || e->cancelled)
+        return false;
+    if (e->wheel_handle.valid())
+    {
+        bool released;
+        timers.cancel(e->wheel_handle, released);
+        if (!released) // still in the timer wheel, so it can be removed right away
+        {
+            delete e;
+            return true;
+        }
+    }
+    e->cancelled = true; // it is in the event heap; it is dropped when popped
+    tombstones++;
+    if (tombstones >= COMPACT_MIN_TOMBSTONES && tombstones * 2 > events.size())
+        compact_events();
+    return true;
+}
+void event::compact_events()
+{
+    vector<event *> &heap = events.container();
+    vector<event *> kept;
+    kept.reserve(heap.size() - tombstones);
+    for (event *e : heap)
+    {
+        if (e->cancelled)
+            delete e;
+        else
+            kept.push_back(e);
+    }
+    heap.swap(kept);
+    make_heap(heap.begin(), heap.end(), mycomp());
+    tombstones = 0;
+}
+
+void event::flush_events()
+{
+    cout << "**flush begin" << endl;
+    while (!events.empty())
+    {
+        cout << setw(11) << events.top()->trigger_time << ": " << setw(11) << events.top()->event_priority() << endl;
+        delete events.top();
+        events.pop();
+    }
+    cout << "**flush end" << endl;
+}
+event *event::get_next_event()
+{
+    if (events.empty())
+        return nullptr;
+    event *e = events.top();
+    events.pop();
+    e->withdraw(); // an event cannot be cancelled once it is fired
+    // cout << events.size() << " events remains" << endl;
+    return e;
+}
+// bench_stats times a run for --bench: the wall time of each phase and the number and the time of the events by type
+// the load phase ends when the simulation starts, and the data phase starts with the first event at or after the first flow
+class bench_stats
+{
+public:
+    struct type_stats
+    {
+        string name;
+        unsigned long long count = 0;
+        double ns = 0;
+    };
+
+private:
+    typedef chrono::steady_clock clock;
+    static bool enabled;
+    static unordered_map<type_index, type_stats> types;
+    static uint data_start;
+    static clock::time_point t_start, t_control, t_data, t_output, t_end;
+    static bool control_started, data_started;
+
+    static double seconds(clock::time_point from, clock::time_point to) { return chrono::duration<double>(to - from).count(); }
+
+public:
+    static void enable()
+    {
+        enabled = true;
+        t_start = clock::now();
+    }
+    static bool isEnabled() { return enabled; }
+    static void setDataStart(uint t) { data_start = t; }
+
+    // time one event's print() and trigger()
+    static void run(event *e)
+    {
+        clock::time_point t0 = clock::now();
+        if (!control_started)
+        {
+            control_started = true;
+            t_control = t0;
+        }
+        if (!data_started && e->getTriggerTime() >= data_start)
+        {
+            data_started = true;
+            t_data = t0;
+        }
+        e->print();
+        e->trigger();
+        type_stats &st = types[type_index(typeid(*e))];
+        if (st.count++ == 0)
+            st.name = e->type();
+        st.ns += chrono::duration<double, nano>(clock::now() - t0).count();
+    }
+    static void output_started() { t_output = clock::now(); }
+
+    // append the run as one line of JSON to path; golden is "match", "mismatch" or "none"
+    static bool write(const string &path, const string &label, const map<string, uint> &input, const string &golden);
+};
+bool bench_stats::enabled = false;
+unordered_map<type_index, bench_stats::type_stats> bench_stats::types;
+uint bench_stats::data_start = UINT_MAX;
+bench_stats::clock::time_point bench_stats::t_start, bench_stats::t_control, bench_stats::t_data, bench_stats::t_output, bench_stats::t_end;
+bool bench_stats::control_started = false;
+bool bench_stats::data_started = false;
+
+bool bench_stats::write(const string &path, const string &label, const map<string, uint> &input, const string &golden)
+{
+    t_end = clock::now();
+    if (!control_started)
+        t_control = t_output;
+    if (!data_started)
+        t_data = t_output;
+    unsigned long long events = 0;
+    for (auto &it : types)
+        events += it.second.count;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    ostringstream os;
+    os << "{\"label\":\"";
+    for (char c : label)
+        os << ((c == '"' || c == '\\') ? "\\" : "") << c;
+    os << "\"";
+    for (auto &it : input)
+        os << ",\"" << it.first << "\":" << it.second;
+    double simulated = seconds(t_control, t_output);
+    os << ",\"phases\":{\"load_s\":" << seconds(t_start, t_control)
+       << ",\"control_s\":" << seconds(t_control, t_data)
+       << ",\"data_s\":" << seconds(t_data, t_output)
+       << ",\"output_s\":" << seconds(t_output, t_end)
+       << ",\"total_s\":" << seconds(t_start, t_end) << "}";
+    os << ",\"events\":" << events << ",\"events_per_s\":" << (simulated > 0 ? events / simulated : 0);
+    // sorted by name, so two reports line up
+    map<string, const type_stats *> by_name;
+    for (auto &it : types)
+        by_name[it.second.name] = &it.second;
+    os << ",\"event_types\":{";
+    for (auto it = by_name.begin(); it != by_name.end(); it++)
+        os << (it == by_name.begin() ? "" : ",") << "\"" << it->first << "\":{\"count\":" << it->second->count
+           << ",\"ns_per_event\":" << it->second->ns / it->second->count << "}";
+    os << "},\"peak_rss_kb\":" << usage.ru_maxrss << ",\"golden\":\"" << golden << "\"}\n";
+
+    FILE *fp = fopen(path.c_str(), "a");
+    if (fp == nullptr)
+        return false;
+    string line = os.str();
+    bool ok = fwrite(line.data(), 1, line.size(), fp) == line.size();
+    return (fclose(fp) == 0) && ok;
+}
+
+void event::start_simulate(uint _end_time)
+{
+    if (_end_time < 0)
+    {
+        cerr << "you should give a possitive value of _end_time" << endl;
+        return;
+    }
+    end_time = _end_time;
+    uint next_checkpoint = 0;
+    if (checkpoint_interval > 0)
+        next_checkpoint = ((events.empty() ? cur_time : events.top()->trigger_time) / checkpoint_interval + 1) * checkpoint_interval;
+    event *e;
+    vector<event *> due;
+    while (true)
+    {
+        // the timers due before the next event join the event heap, so they are ordered like any other event
+        // with an empty heap, only the earliest timers are taken, as the ones after them may still be cancelled
+        if (events.empty())
+            timers.release(end_time, due, true);
+        else
+            timers.release(min(events.top()->trigger_time, end_time), due);
+        for (event *t : due)
+            events.push(t);
+        due.clear();
+
+        // the snapshot is taken between two events, right before the first event at or after next_checkpoint
+        if (checkpoint_interval > 0 && !events.empty() && events.top()->trigger_time >= next_checkpoint && events.top()->trigger_time <= end_time)
+        {
+            if (!checkpoint(checkpoint_path))
+                cerr << "cannot write the checkpoint " << checkpoint_path << endl;
+            next_checkpoint = (events.top()->trigger_time / checkpoint_interval + 1) * checkpoint_interval;
+        }
+        // events after end_time stay in the queue, so the simulation can be continued by another start_simulate()
+        if (events.empty() || events.top()->trigger_time > end_time)
+            break;
+        e = event::get_next_event();
+
+        if (cur_time <= e->trigger_time)
+            cur_time = e->trigger_time;
+        else
+        {
+            cerr << "cur_time = " << cur_time << ", event trigger_time = " << e->trigger_time << endl;
+            break;
+        }
+        if (e->cancelled)
+        {
+            tombstones--;
+            delete e;
+            continue;
+        }
+
+        if (sim_metrics::isEnabled())
+        {
+            sim_metrics::queue_depth(e->trigger_time, events.size() + 1 + timers.size());
+            pair<string, unsigned long long> &count = sim_metrics::mine().events[type_index(typeid(*e))];
+            if (count.second++ == 0)
+                count.first = e->type();
+        }
+        if (bench_stats::isEnabled())
+        {
+            bench_stats::run(e);
+            delete e;
+            continue;
+        }
+        // cout << "event trigger_time = " << e->trigger_time << endl;
+        e->print(); // for log
+        // cout << " event begin" << endl;
+        e->trigger();
+        // cout << " event end" << endl;
+        delete e;
+    }
+    // cout << "no more event" << endl;
+    if (sim_metrics::isEnabled() && !sim_metrics::write(cur_time))
+        cerr << "cannot write the metrics" << endl;
+}
+
+bool mycomp::operator()(const event *lhs, const event *rhs) const
+{
+    // cout << lhs->getTriggerTime() << ", " << rhs->getTriggerTime() << endl;
+    // cout << lhs->type() << ", " << rhs->type() << endl;
+    uint lhs_pri = lhs->event_priority();
+    uint rhs_pri = rhs->event_priority();
+    // cout << "lhs hash = " << lhs_pri << endl;
+    // cout << "rhs hash = " << rhs_pri << endl;
+
+    if (event::isStableOrder() && lhs->getTriggerTime() == rhs->getTriggerTime() && lhs_pri == rhs_pri) // the earlier created event goes first
+        return reverse ? (lhs->getSeq() < rhs->getSeq()) : (lhs->getSeq() > rhs->getSeq());
+    if (reverse)
+        return ((lhs->getTriggerTime()) == (rhs->getTriggerTime())) ? (lhs_pri < rhs_pri) : ((lhs->getTriggerTime()) < (rhs->getTriggerTime()));
+    else
+        return ((lhs->getTriggerTime()) == (rhs->getTriggerTime())) ? (lhs_pri > rhs_pri) : ((lhs->getTriggerTime()) > (rhs->getTriggerTime()));
+}
+
+class recv_event : public event
+{
+public:
+    class recv_data; // forward declaration
+
+private:
+    recv_event(recv_event &) {} // this constructor cannot be used
+    recv_event() {}             // we don't allow users to new a recv_event by themselv
+    uint senderID;              // the sender
+    uint receiverID;            // the receiver; the packet will be given to the receiver
+    packet *pkt;                // the packet
+
+protected:
+    // this constructor cannot be directly called by users; only by generator
+    recv_event(uint _trigger_time, void *data) : event(_trigger_time), senderID(BROCAST_ID), receiverID(BROCAST_ID), pkt(nullptr)
+    {
+        recv_data *data_ptr = (recv_data *)data;
+        senderID = data_ptr->s_id;
+        receiverID = data_ptr->r_id; // the packet will be given to the receiver
+        pkt = data_ptr->_pkt;
+    }
+
+public:
+    virtual ~recv_event() { packet::discard(pkt); } // the packet is still owned by the event if it never fired
+    virtual uint held_packets() const { return pkt != nullptr; }
+    // recv_event will trigger the recv function
+    virtual void trigger();
+
+    uint event_priority() const;
+    // the priority of a recv_event with these fields; it is also used to predict the order of packet arrivals
+    static uint priority_of(uint _trigger_time, uint s_id, uint r_id, uint p_id);
+
+    string type() { return "recv_event"; }
+    void save(snapshot_writer &w) const
+    {
+        w.put(senderID);
+        w.put(receiverID);
+        pkt->save(w);
+    }
+
+    class recv_event_generator;
+    friend class recv_event_generator;
+    // recv_event is derived from event_generator to generate a event
+    class recv_event_generator : public event_generator
+    {
+        static recv_event_generator sample;
+        // this constructor is only for sample to register this event type
+        recv_event_generator() { /*cout << "recv_event registered" << endl;*/ register_event_type(&sample); }
+
+    protected:
+        virtual event *generate(uint _trigger_time, void *data)
+        {
+            // cout << "recv_event generated" << endl;
+            return new recv_event(_trigger_time, data);
+        }
+        virtual event *restore(uint _trigger_time, snapshot_reader &r)
+        {
+            recv_data e_data;
+            e_data.s_id = r.get<uint>();
+            e_data.r_id = r.get<uint>();
+            e_data._pkt = packet::restore(r);
+            if (e_data._pkt == nullptr)
+                return nullptr;
+            return new recv_event(_trigger_time, (void *)&e_data);
+        }
+
+    public:
+        virtual string type() { return "recv_event"; }
+        ~recv_event_generator() {}
+    };
+    // this class is used to initialize the recv_event
+    class recv_data
+    {
+    public:
+        uint s_id;
+        uint r_id;
+        packet *_pkt;
+    };
+
+    void print() const;
+};
+recv_event::recv_event_generator recv_event::recv_event_generator::sample;
+
+void recv_event::trigger()
+{
+    if (pkt == nullptr)
+    {
+        cerr << "recv_event error: no pkt!" << endl;
+        return;
+    }
+    else if (node::id_to_node(receiverID) == nullptr)
+    {
+        cerr << "recv_event error: no node " << receiverID << "!" << endl;
+        packet::discard(pkt);
+        return;
+    }
+    packet *p = pkt;
+    pkt = nullptr; // the node takes the packet
+    node::id_to_node(receiverID)->recv(p);
+}
+uint recv_event::event_priority() const
+{
+    return priority_of(getTriggerTime(), senderID, receiverID, pkt->getPacketID());
+}
+uint recv_event::priority_of(uint _trigger_time, uint s_id, uint r_id, uint p_id)
+{
+    string string_for_hash;
+    string_for_hash = to_string(_trigger_time) + to_string(s_id) + to_string(r_id) + to_string(p_id);
+    return get_hash_value(string_for_hash);
+}
+// the recv_event::print() function is used for log file
+void recv_event::print() const
+{
+    cout << "time " << setw(11) << event::getCurTime()
+         << "   recID" << setw(11) << receiverID
+         << "   pktID" << setw(11) << pkt->getPacketID()
+         << "   srcID" << setw(11) << pkt->getHeader()->getSrcID()
+         << "   dstID" << setw(11) << pkt->getHeader()->getDstID()
+         << "   preID" << setw(11) << pkt->getHeader()->getPreID()
+         << "   nexID" << setw(11) << pkt->getHeader()->getNexID()
+         << "   " << pkt->type()
+         << pkt->addition_information();
+    //  if ( pkt->type() == "TRA_ctrl_packet" ) cout << "   " << ((TRA_ctrl_payload*)pkt->getPayload())->getCounter();
+    cout << endl;
+    // cout << pkt->type()
+    //      << "   time "       << setw(11) << event::getCurTime()
+    //      << "   recID "      << setw(11) << receiverID
+    //      << "   pktID"       << setw(11) << pkt->getPacketID()
+    //      << "   srcID "      << setw(11) << pkt->getHeader()->getSrcID()
+    //      << "   dstID"       << setw(11) << pkt->getHeader()->getDstID()
+    //      << "   preID"       << setw(11) << pkt->getHeader()->getPreID()
+    //      << "   nexID"       << setw(11) << pkt->getHeader()->getNexID()
+    //      << endl;
+}
+
+class send_event : public event
+{
+public:
+    class send_data; // forward declaration
+
+private:
+    send_event(send_event &) {}
+    send_event() {} // we don't allow users to new a recv_event by themselves
+    // this constructor cannot be directly called by users; only by generator
+    uint senderID;   // the sender
+    uint receiverID; // the receiver
+    packet *pkt;     // the packet
+
+protected:
+    send_event(uint _trigger_time, void *data) : event(_trigger_time), senderID(BROCAST_ID), receiverID(BROCAST_ID), pkt(nullptr)
+    {
+        send_data *data_ptr = (send_data *)data;
+        senderID = data_ptr->s_id;
+        receiverID = data_ptr->r_id;
+        pkt = data_ptr->_pkt;
+    }
+
+public:
+    virtual ~send_event() { packet::discard(pkt); } // the packet is still owned by the event if it never fired
+    virtual uint held_packets() const { return pkt != nullptr; }
+    // send_event will trigger the send function
+    virtual void trigger();
+
+    uint event_priority() const;
+
+    string type() { return "send_event"; }
+    void save(snapshot_writer &w) const
+    {
+        w.put(senderID);
+        w.put(receiverID);
+        pkt->save(w);
+    }
+
+    class send_event_generator;
+    friend class send_event_generator;
+    // send_event is derived from event_generator to generate a event
+    class send_event_generator : public event_generator
+    {
+        static send_event_generator sample;
+        // this constructor is only for sample to register this event type
+        send_event_generator() { /*cout << "send_event registered" << endl;*/ register_event_type(&sample); }
+
+    protected:
+        virtual event *generate(uint _trigger_time, void *data)
+        {
+            // cout << "send_event generated" << endl;
+            return new send_event(_trigger_time, data);
+        }
+        virtual event *restore(uint _trigger_time, snapshot_reader &r)
+        {
+            send_data e_data;
+            e_data.s_id = r.get<uint>();
+            e_data.r_id = r.get<uint>();
+            e_data._pkt = packet::restore(r);
+            if (e_data._pkt == nullptr)
+                return nullptr;
+            return new send_event(_trigger_time, (void *)&e_data);
+        }
+
+    public:
+        virtual string type() { return "send_event"; }
+        ~send_event_generator() {}
+    };
+    // this class is used to initialize the send_event
+    class send_data
+    {
+    public:
+        uint s_id;
+        uint r_id;
+        packet *_pkt;
+        uint t;
+    };
+
+    void print() const;
+};
+send_event::send_event_generator send_event::send_event_generator::sample;
+
+uint send_event::event_priority() const
+{
+    string string_for_hash;
+    string_for_hash = to_string(getTriggerTime()) + to_string(senderID) + to_string(receiverID) + to_string(pkt->getPacketID());
+    return get_hash_value(string_for_hash);
+}
+// the send_event::print() function is used for log file
+void send_event::print() const
+{
+    cout << "time " << setw(11) << event::getCurTime()
+         << "   senID" << setw(11) << senderID
+         << "   pktID" << setw(11) << pkt->getPacketID()
+         << "   srcID" << setw(11) << pkt->getHeader()->getSrcID()
+         << "   dstID" << setw(11) << pkt->getHeader()->getDstID()
+         << "   preID" << setw(11) << pkt->getHeader()->getPreID()
+         << "   nexID" << setw(11) << pkt->getHeader()->getNexID()
+         << "   " << pkt->type()
+         << pkt->addition_information()
+         //<< "   msg"         << setw(11) << dynamic_cast<TRA_data_payload*>(pkt->getPayload())->getMsg()
+         << endl;
+    // cout << pkt->type()
+    //      << "   time "       << setw(11) << event::getCurTime()
+    //      << "   senID "      << setw(11) << senderID
+    //      << "   pktID"       << setw(11) << pkt->getPacketID()
+    //      << "   srcID "      << setw(11) << pkt->getHeader()->getSrcID()
+    //      << "   dstID"       << setw(11) << pkt->getHeader()->getDstID()
+    //      << "   preID"       << setw(11) << pkt->getHeader()->getPreID()
+    //      << "   nexID"       << setw(11) << pkt->getHeader()->getNexID()
+    //      << endl;
+}
+
+// timer_event calls the node's timer_handler; it is kept in the timer wheel until it is due
+class timer_event : public event
+{
+public:
+    class timer_data; // forward declaration
+
+private:
+    timer_event(timer_event &) : event() {}
+    timer_event() {} // we don't allow users to new a timer_event by themselves
+    uint nodeID;     // the node owning the timer
+    uint timerID;    // the id given to node::set_timer
+
+protected:
+    // this constructor cannot be directly called by users; only by generator
+    timer_event(uint _trigger_time, void *data) : event(_trigger_time), nodeID(BROCAST_ID), timerID(0)
+    {
+        timer_data *data_ptr = (timer_data *)data;
+        nodeID = data_ptr->n_id;
+        timerID = data_ptr->t_id;
+    }
+    bool use_timer_wheel() const { return true; }
+
+public:
+    virtual ~timer_event() {}
+    // timer_event will trigger the timer_handler function
+    virtual void trigger();
+
+    uint event_priority() const;
+
+    string type() { return "timer_event"; }
+    void save(snapshot_writer &w) const
+    {
+        w.put(nodeID);
+        w.put(timerID);
+    }
+
+    class timer_event_generator;
+    friend class timer_event_generator;
+    // timer_event is derived from event_generator to generate a event
+    class timer_event_generator : public event_generator
+    {
+        static timer_event_generator sample;
+        // this constructor is only for sample to register this event type
+        timer_event_generator() { register_event_type(&sample); }
+
+    protected:
+        virtual event *generate(uint _trigger_time, void *data)
+        {
+            return new timer_event(_trigger_time, data);
+        }
+        virtual event *restore(uint _trigger_time, snapshot_reader &r)
+        {
+            timer_data e_data;
+            e_data.n_id = r.get<uint>();
+            e_data.t_id = r.get<uint>();
+            return new timer_event(_trigger_time, (void *)&e_data);
+        }
+
+    public:
+        virtual string type() { return "timer_event"; }
+        ~timer_event_generator() {}
+    };
+    // this class is used to initialize the timer_event
+    class timer_data
+    {
+    public:
+        uint n_id;
+        uint t_id;
+    };
+
+    void print() const;
+};
+timer_event::timer_event_generator timer_event::timer_event_generator::sample;
+
+void timer_event::trigger()
+{
+    if (node::id_to_node(nodeID) == nullptr)
+    {
+        cerr << "timer_event error: no node " << nodeID << "!" << endl;
+        return;
+    }
+    node::id_to_node(nodeID)->timer_handler(timerID);
+}
+uint timer_event::event_priority() const
+{
+    string string_for_hash;
+    string_for_hash = to_string(getTriggerTime()) + to_string(nodeID) + "timer" + to_string(timerID);
+    return get_hash_value(string_for_hash);
+}
+// the timer_event::print() function is used for log file
+void timer_event::print() const
+{
+    cout << "time " << setw(11) << event::getCurTime()
+         << "   nodID" << setw(11) << nodeID
+         << "   timer" << setw(11) << timerID
+         << endl;
+}
+
+event_handle node::set_timer(uint delay, uint timer_id)
+{
+    timer_event::timer_data e_data;
+    e_data.n_id = id;
+    e_data.t_id = timer_id;
+    event_handle h = event::event_generator::generate("timer_event", event::getCurTime() + delay, (void *)&e_data);
+    if (!h.valid())
+        cerr << "event type is incorrect" << endl;
+    return h;
+}
+bool node::cancel_timer(event_handle h)
+{
+    return event::cancel(h);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class TRA_data_pkt_gen_event : public event
+{
+public:
+    class gen_data; // forward declaration
+
+private:
+    TRA_data_pkt_gen_event(TRA_data_pkt_gen_event &) {}
+    TRA_data_pkt_gen_event() {} // we don't allow users to new a recv_event by themselves
+    // this constructor cannot be directly called by users; only by generator
+    uint src; // the src
+    uint dst; // the dst
+    double size;
+    // packet *pkt; // the packet
+    string msg;
+
+protected:
+    TRA_data_pkt_gen_event(uint _trigger_time, void *data) : event(_trigger_time), src(BROCAST_ID), dst(BROCAST_ID)
+    {
+        pkt_gen_data *data_ptr = (pkt_gen_data *)data;
+        src = data_ptr->src_id;
+        dst = data_ptr->dst_id;
+        size = data_ptr->_size;
+        // pkt = data_ptr->_pkt;
+        msg = data_ptr->msg;
+    }
+
+public:
+    virtual ~TRA_data_pkt_gen_event() {}
+    // TRA_data_pkt_gen_event will trigger the packet gen function
+    virtual void trigger();
+
+    uint event_priority() const;
+
+    string type() { return "TRA_data_pkt_gen_event"; }
+    void save(snapshot_writer &w) const
+    {
+        w.put(src);
+        w.put(dst);
+        w.put(size);
+        w.put_str(msg);
+    }
+
+    class TRA_data_pkt_gen_event_generator;
+    friend class TRA_data_pkt_gen_event_generator;
+    // TRA_data_pkt_gen_event_generator is derived from event_generator to generate an event
+    class TRA_data_pkt_gen_event_generator : public event_generator
+    {
+        static TRA_data_pkt_gen_event_generator sample;
+        // this constructor is only for sample to register this event type
+        TRA_data_pkt_gen_event_generator() { /*cout << "send_event registered" << endl;*/ register_event_type(&sample); }
+
+    protected:
+        virtual event *generate(uint _trigger_time, void *data)
+        {
+            // cout << "send_event generated" << endl;
+            return new TRA_data_pkt_gen_event(_trigger_time, data);
+        }
+        virtual event *restore(uint _trigger_time, snapshot_reader &r)
+        {
+            pkt_gen_data e_data;
+            e_data.src_id = r.get<uint>();
+            e_data.dst_id = r.get<uint>();
+            e_data._size = r.get<double>();
+            e_data.msg = r.get_str();
+            return new TRA_data_pkt_gen_event(_trigger_time, (void *)&e_data);
+        }
+
+    public:
+        virtual string type() { return "TRA_data_pkt_gen_event"; }
+        ~TRA_data_pkt_gen_event_generator() {}
+    };
+    // this class is used to initialize the TRA_data_pkt_gen_event
+    class pkt_gen_data
+    {
+    public:
+        uint src_id;
+        uint dst_id;
+        double _size;
+        string msg;
+        // packet *_pkt;
+    };
+
+    void print() const;
+};
+TRA_data_pkt_gen_event::TRA_data_pkt_gen_event_generator TRA_data_pkt_gen_event::TRA_data_pkt_gen_event_generator::sample;
+
+void TRA_data_pkt_gen_event::trigger()
+{
+    if (node::id_to_node(src) == nullptr)
+    {
+        cerr << "TRA_data_pkt_gen_event error: no node " << src << "!" << endl;
+        return;
+    }
+    else if (dst != BROCAST_ID && node::id_to_node(dst) == nullptr)
+    {
+        cerr << "TRA_data_pkt_gen_event error: no node " << dst << "!" << endl;
+        return;
+    }
+
+    TRA_data_packet *pkt = dynamic_cast<TRA_data_packet *>(packet::packet_generator::generate("TRA_data_packet"));
+    if (pkt == nullptr)
+    {
+        cerr << "packet type is incorrect" << endl;
+        return;
+    }
+    TRA_data_header *hdr = dynamic_cast<TRA_data_header *>(pkt->getHeader());
+    TRA_data_payload *pld = dynamic_cast<TRA_data_payload *>(pkt->getPayload());
+
+    if (hdr == nullptr)
+    {
+        cerr << "header type is incorrect" << endl;
+        return;
+    }
+    if (pld == nullptr)
+    {
+        cerr << "payload type is incorrect" << endl;
+        return;
+    }
+
+    hdr->setSrcID(src);
+    hdr->setDstID(dst);
+    hdr->setPreID(src); // this column is not important when the packet is first received by the src (i.e., just generated)
+    hdr->setNexID(src); // this column is not important when the packet is first received by the src (i.e., just generated)
+
+    pld->setMsg(msg);
+
+    pkt->setSize(size);
+    hdr->setFlowSize(size);
+
+    // cout << "**size = " << pkt->getSize() << "**" << endl ;
+
+    recv_event::recv_data e_data;
+    e_data.s_id = src;
+    e_data.r_id = src; // to make the packet start from the src
+    e_data._pkt = pkt;
+
+    event_handle h = event::event_generator::generate("recv_event", trigger_time, (void *)&e_data);
+}
+uint TRA_data_pkt_gen_event::event_priority() const
+{
+    string string_for_hash;
+    string_for_hash = to_string(getTriggerTime()) + to_string(src) + to_string(dst); // to_string (pkt->getPacketID());
+    return get_hash_value(string_for_hash);
+}
+// the TRA_data_pkt_gen_event::print() function is used for log file
+void TRA_data_pkt_gen_event::print() const
+{
+    cout << "time " << setw(11) << event::getCurTime()
+         << "        " << setw(11) << " "
+         << "        " << setw(11) << " "
+         << "   srcID" << setw(11) << src
+         << "   dstID" << setw(11) << dst
+         << "        " << setw(11) << " "
+         << "        " << setw(11) << " "
+         << "   TRA_data_packet generating" // << setw(5) << size
+         << endl;
+}
+
+class TRA_ctrl_pkt_gen_event : public event
+{
+public:
+    class gen_data; // forward declaration
+
+private:
+    TRA_ctrl_pkt_gen_event(TRA_ctrl_pkt_gen_event &) {}
+    TRA_ctrl_pkt_gen_event() {} // we don't allow users to new a recv_event by themselves
+    // this constructor cannot be directly called by users; only by generator
+    uint src; // the src
+    uint dst; // the dst
+    double size;
+    // uint mat;
+    // uint act;
+    // packet *pkt; // the packet
+    string msg;
+    // double per; // percentage
+    uint period; // if period > 0, the event schedules its next occurrence when it fires
+    uint until;  // the last time the event may be rescheduled to
+
+protected:
+    TRA_ctrl_pkt_gen_event(uint _trigger_time, void *data) : event(_trigger_time), src(BROCAST_ID), dst(BROCAST_ID)
+    {
+        pkt_gen_data *data_ptr = (pkt_gen_data *)data;
+        src = data_ptr->src_id;
+        dst = data_ptr->dst_id;
+        size = data_ptr->_size;
+        // pkt = data_ptr->_pkt;
+        // mat = data_ptr->mat_id;
+        // act = data_ptr->act_id;
+        msg = data_ptr->msg;
+        // per = data_ptr->per;
+        period = data_ptr->period;
+        until = data_ptr->until;
+    }
+    // the periodic broadcasts are protocol timers, so they wait in the timer wheel instead of the event heap
+    bool use_timer_wheel() const { return period > 0; }
+
+public:
+    virtual ~TRA_ctrl_pkt_gen_event() {}
+    // TRA_ctrl_pkt_gen_event will trigger the packet gen function
+    virtual void trigger();
+
+    uint event_priority() const;
+    static uint priority_of(uint _trigger_time, uint src_id, uint dst_id);
+
+    string type() { return "TRA_ctrl_pkt_gen_event"; }
+    void save(snapshot_writer &w) const
+    {
+        w.put(src);
+        w.put(dst);
+        w.put(size);
+        w.put_str(msg);
+        w.put(period);
+        w.put(until);
+    }
+
+    class TRA_ctrl_pkt_gen_event_generator;
+    friend class TRA_ctrl_pkt_gen_event_generator;
+    // TRA_ctrl_pkt_gen_event_generator is derived from event_generator to generate an event
+    class TRA_ctrl_pkt_gen_event_generator : public event_generator
+    {
+        static TRA_ctrl_pkt_gen_event_generator sample;
+        // this constructor is only for sample to register this event type
+        TRA_ctrl_pkt_gen_event_generator() { /*cout << "send_event registered" << endl;*/ register_event_type(&sample); }
+
+    protected:
+        virtual event *generate(uint _trigger_time, void *data)
+        {
+            // cout << "send_event generated" << endl;
+            return new TRA_ctrl_pkt_gen_event(_trigger_time, data);
+        }
+        virtual event *restore(uint _trigger_time, snapshot_reader &r)
+        {
+            pkt_gen_data e_data;
+            e_data.src_id = r.get<uint>();
+            e_data.dst_id = r.get<uint>();
+            e_data._size = r.get<double>();
+            e_data.msg = r.get_str();
+            e_data.period = r.get<uint>();
+            e_data.until = r.get<uint>();
+            return new TRA_ctrl_pkt_gen_event(_trigger_time, (void *)&e_data);
+        }
+
+    public:
+        virtual string type() { return "TRA_ctrl_pkt_gen_event"; }
+        ~TRA_ctrl_pkt_gen_event_generator() {}
+    };
+    // this class is used to initialize the TRA_ctrl_pkt_gen_event
+    class pkt_gen_data
+    {
+    public:
+        uint src_id;
+        uint dst_id;
+        double _size;
+        // uint mat_id; // the target of the rule
+        // uint act_id; // the next hop toward the target recorded in the rule
+        string msg;
+        // double per; // the percentage
+        // packet *_pkt;
+        uint period = 0; // 0 means that the event fires only once
+        uint until = 0;
+    };
+
+    void print() const;
+};
+TRA_ctrl_pkt_gen_event::TRA_ctrl_pkt_gen_event_generator TRA_ctrl_pkt_gen_event::TRA_ctrl_pkt_gen_event_generator::sample;
+
+void TRA_ctrl_pkt_gen_event::trigger()
+{
+
+    TRA_ctrl_packet *pkt = dynamic_cast<TRA_ctrl_packet *>(packet::packet_generator::generate("TRA_ctrl_packet"));
+    if (pkt == nullptr)
+    {
+        cerr << "packet type is incorrect" << endl;
+        return;
+    }
+    TRA_ctrl_header *hdr = dynamic_cast<TRA_ctrl_header *>(pkt->getHeader());
+    TRA_ctrl_payload *pld = dynamic_cast<TRA_ctrl_payload *>(pkt->getPayload());
+
+    if (hdr == nullptr)
+    {
+        cerr << "header type is incorrect" << endl;
+        return;
+    }
+    if (pld == nullptr)
+    {
+        cerr << "payload type is incorrect" << endl;
+        return;
+    }
+
+    hdr->setSrcID(src);
+    hdr->setDstID(dst);
+    hdr->setPreID(src);
+    // hdr->setNexID(dst); // in hw3, you should set NexID to src
+    hdr->setNexID(src);
+
+    // payload
+    pld->setMsg(msg);
+    pld->setnid(src); // add this line
+    // pld->setMatID(mat);
+    // pld->setActID(act);
+    // pld->setPer(per);
+    pkt->setSize(size);
+
+    recv_event::recv_data e_data;
+    e_data.s_id = src;
+    // e_data.r_id = dst; // in hw3, you should set r_id it src
+    e_data.r_id = src;
+    e_data._pkt = pkt;
+
+    event_handle h = event::event_generator::generate("recv_event", trigger_time, (void *)&e_data);
+
+    // a periodic broadcast only keeps its next occurrence in the queue
+    if (period > 0 && until >= trigger_time && until - trigger_time >= period)
+    {
+        pkt_gen_data next_data;
+        next_data.src_id = src;
+        next_data.dst_id = dst;
+        next_data._size = size;
+        next_data.msg = msg;
+        next_data.period = period;
+        next_data.until = until;
+        event::event_generator::generate("TRA_ctrl_pkt_gen_event", trigger_time + period, (void *)&next_data);
+    }
+}
+uint TRA_ctrl_pkt_gen_event::event_priority() const
+{
+    return priority_of(getTriggerTime(), src, dst);
+}
+uint TRA_ctrl_pkt_gen_event::priority_of(uint _trigger_time, uint src_id, uint dst_id)
+{
+    string string_for_hash;
+    // string_for_hash = to_string(getTriggerTime()) + to_string(src) + to_string(dst) + to_string(mat) + to_string(act); //to_string (pkt->getPacketID());
+    string_for_hash = to_string(_trigger_time) + to_string(src_id) + to_string(dst_id); // to_string (pkt->getPacketID());
+    return get_hash_value(string_for_hash);
+}
+// the TRA_ctrl_pkt_gen_event::print() function is used for log file
+void TRA_ctrl_pkt_gen_event::print() const
+{
+    cout << "time " << setw(11) << event::getCurTime()
+         << "        " << setw(11) << " "
+         << "        " << setw(11) << " "
+         << "   srcID" << setw(11) << src
+         << "   dstID" << setw(11) << dst
+         << "        " << setw(11) << " "
+         << "        " << setw(11) << " "
+         //  << "   matID"       << setw(11) << mat
+         //  << "   actID"       << setw(11) << act
+         << "   TRA_ctrl_packet generating"
+         << endl;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class link
+{
+    // all links created in the program
+    class id_pair_hash
+    {
+    public:
+        size_t operator()(const pair<uint, uint> &key) const { return (size_t(key.first) << 32 | key.second) * 0x9E3779B97F4A7C15ULL; }
+    };
+    static unordered_map<pair<uint, uint>, link *, id_pair_hash> id_id_link_table;
+
+    uint id1; // from
+    uint id2; // to
+
+protected:
+    link(link &) {} // this constructor should not be used
+    link() {}       // this constructor should not be used
+    link(uint _id1, uint _id2) : id1(_id1), id2(_id2) { id_id_link_table[pair<uint, uint>(id1, id2)] = this; }
+
+public:
+    virtual ~link()
+    {
+        id_id_link_table.erase(pair<uint, uint>(id1, id2)); // erase the link
+    }
+    MEM_ACCOUNTED(LINK)
+
+    static link *id_id_to_link(uint _id1, uint _id2)
+    {
+        auto it = id_id_link_table.find(pair<uint, uint>(_id1, _id2));
+        return (it != id_id_link_table.end()) ? it->second : nullptr;
+    }
+    // make room for n links up front
+    static void reserve(size_t n) { id_id_link_table.reserve(n); }
+
+    virtual uint getLatency() = 0; // you must implement your own latency
+
+    static void del_link(uint _id1, uint _id2)
+    {
+        pair<uint, uint> temp;
+        if (id_id_link_table.find(temp) != id_id_link_table.end())
+            id_id_link_table.erase(temp);
+    }
+
+    static uint getLinkNum() { return id_id_link_table.size(); }
+
+    virtual bool canTransmit(map<string, double> args = {}) = 0;
+    virtual void reserve(map<string, double> args = {}) = 0;
+
+    // save/load the link's own state (e.g., its occupancy) for checkpointing
+    virtual void save(snapshot_writer & /*w*/) const {}
+    virtual void load(snapshot_reader & /*r*/) {}
+    static void save_all(snapshot_writer &w);
+    static bool load_all(snapshot_reader &r);
+
+    class link_generator
+    {
+        // lock the copy constructor
+        link_generator(link_generator &) {}
+        // store all possible types of link
+        static map<string, link_generator *> prototypes;
+
+    protected:
+        // allow derived class to use it
+        link_generator() {}
+        // after you create a new link type, please register the factory of this link type by this function
+        void register_link_type(link_generator *h) { prototypes[h->type()] = h; }
+        // you have to implement your own generate() to generate your link
+        virtual link *generate(uint _id1, uint _id2, map<string, double> args = {}) = 0;
+
+    public:
+        // you have to implement your own type() to return your link type
+        virtual string type() = 0;
+        // this function is used to generate any type of link derived
+        static link *generate(string type, uint _id1, uint _id2, map<string, double> args = {})
+        {
+            if (id_id_link_table.find(pair<uint, uint>(_id1, _id2)) != id_id_link_table.end())
+            {
+                std::cerr << "duplicate link id" << std::endl; // link id is duplicated
+                return nullptr;
+            }
+            else if (BROCAST_ID == _id1 || BROCAST_ID == _id2)
+            {
+                cerr << "BROCAST_ID cannot be used" << endl;
+                return nullptr;
+            }
+            else if (prototypes.find(type) != prototypes.end())
+            { // if this type derived exists
+                link *created_link = prototypes[type]->generate(_id1, _id2, args);
+                return created_link; // generate it!!
+            }
+            std::cerr << "no such link type" << std::endl; // otherwise
+            return nullptr;
+        }
+        // bulk version of generate() for the links from _id1 to each _id2[i] with capacity[i]; the type is looked up
+        // once and the ids are not checked again, so they must be distinct existing nodes without a link yet
+        static bool generate_all(string type, uint _id1, const uint *_id2, const double *capacity, uint n)
+        {
+            map<string, link_generator *>::iterator it = prototypes.find(type);
+            if (it == prototypes.end())
+            {
+                std::cerr << "no such link type" << std::endl;
+                return false;
+            }
+            map<string, double> args = {{"capacity", 0}};
+            double &arg_capacity = args["capacity"];
+            for (uint i = 0; i < n; i++)
+            {
+                arg_capacity = capacity[i];
+                it->second->generate(_id1, _id2[i], args);
+            }
+            return true;
+        }
+        static void print()
+        {
+            cout << "registered link types: " << endl;
+            for (map<string, link::link_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
+                cout << it->second->type() << endl;
+        }
+        virtual ~link_generator() {};
+    };
+};
+map<string, link::link_generator *> link::link_generator::prototypes;
+unordered_map<pair<uint, uint>, link *, link::id_pair_hash> link::id_id_link_table;
+
+void link::save_all(snapshot_writer &w)
+{
+    // in (id1, id2) order, so the snapshot does not depend on the hash table's layout
+    vector<pair<uint, uint>> ids;
+    ids.reserve(id_id_link_table.size());
+    for (auto it = id_id_link_table.begin(); it != id_id_link_table.end(); it++)
+        ids.push_back(it->first);
+    sort(ids.begin(), ids.end());
+    w.put<uint>(ids.size());
+    for (const pair<uint, uint> &id : ids)
+    {
+        w.put(id.first);
+        w.put(id.second);
+        id_id_link_table[id]->save(w);
+    }
+}
+bool link::load_all(snapshot_reader &r)
+{
+    uint n = r.get<uint>();
+    if (n != id_id_link_table.size())
+    {
+        cerr << "snapshot error: the snapshot has " << n << " links but the topology has " << id_id_link_table.size() << endl;
+        return false;
+    }
+    for (; n > 0 && r.ok(); n--)
+    {
+        uint _id1 = r.get<uint>();
+        uint _id2 = r.get<uint>();
+        link *l = id_id_to_link(_id1, _id2);
+        if (l == nullptr)
+        {
+            cerr << "snapshot error: no such link" << endl;
+            return false;
+        }
+        l->load(r);
+    }
+    return r.ok();
+}
+
+void node::add_phy_neighbor(uint _id, string link_type, map<string, double> link_args)
+{
+    if (id == _id)
+        return; // if the two nodes are the same...
+    if (id_node_table.find(_id) == id_node_table.end())
+        return; // if this node does not exist
+    if (phy_neighbors.find(_id) != phy_neighbors.end())
+        return; // if this neighbor has been added
+    phy_neighbors[_id] = true;
+
+    link::link_generator::generate(link_type, id, _id, link_args);
+}
+
+void node::add_phy_neighbors(const uint *_ids, uint n)
+{
+    for (uint i = 0; i < n; i++)
+        phy_neighbors.emplace_hint(phy_neighbors.end(), _ids[i], true);
+}
+
+void node::del_phy_neighbor(uint _id)
+{
+    phy_neighbors.erase(_id);
+}
+
+class simple_link : public link
+{
+    double capacity = 100; // default capacity is set to 100; please set your link's capacity manually by add_phy_neighbor
+    double occupied = 0;   // default occupied is set to 0
+
+    uint latency = ONE_HOP_DELAY; // default latency
+
+    friend class microbench; // it clears the occupancy between batches
+
+protected:
+    simple_link() {}                                        // it should not be used outside the class
+    simple_link(simple_link &) {}                           // it should not be used
+    simple_link(uint _id1, uint _id2) : link(_id1, _id2) {} // this constructor cannot be directly called by users
+
+public:
+    virtual ~simple_link() {}
+    virtual uint getLatency() { return latency; } // you can implement your own latency
+
+    SET(setCapacity, uint, capacity, _capacity);
+    GET(getCapacity, double, capacity);
+    GET(getOccupied, double, occupied);
+
+    SET(setLatency, uint, latency, _latency);
+
+    virtual void save(snapshot_writer &w) const
     {
-        cout << setw(11) << events.top()->trigger_time << ": " << setw(11) << events.top()->event_priority() << endl;
-        delete events.top();
-        events.pop();
+        w.put(capacity);
+        w.put(occupied);
+        w.put(latency);
     }
-    cout << "**flush end" << endl;
+    virtual void load(snapshot_reader &r)
+    {
+        capacity = r.get<double>();
+        occupied = r.get<double>();
+        latency = r.get<uint>();
+    }
+
+    bool canTransmit(map<string, double> args = {})
+    {
+        if (args.find("pkt_size") != args.end())
+            return (occupied + args["pkt_size"] <= capacity);
+        return false;
+    }
+    void reserve(map<string, double> args = {})
+    {
+        if (args.find("pkt_size") != args.end())
+            occupied += args["pkt_size"];
+    }
+
+    class simple_link_generator;
+    friend class simple_link_generator;
+    // simple_link is derived from link_generator to generate a link
+    class simple_link_generator : public link_generator
+    {
+        static simple_link_generator sample;
+        // this constructor is only for sample to register this link type
+        simple_link_generator() { /*cout << "simple_link registered" << endl;*/ register_link_type(&sample); }
+
+    protected:
+        virtual link *generate(uint _id1, uint _id2, map<string, double> args = {})
+        { /*cout << "simple_link generated" << endl;*/
+            simple_link *l = new simple_link(_id1, _id2);
+            if (args.find("capacity") != args.end())
+                l->setCapacity(static_cast<uint>(args["capacity"]));
+            if (args.find("latency") != args.end())
+                l->setLatency(static_cast<uint>(args["latency"]));
+            return l;
+        }
+
+    public:
+        virtual string type() { return "simple_link"; }
+        ~simple_link_generator() {}
+    };
+};
+
+simple_link::simple_link_generator simple_link::simple_link_generator::sample;
+
+bool event::checkpoint(const string &path)
+{
+    snapshot_writer w;
+    w.put_str("TRA_snapshot");
+    w.put<uint>(7); // format version
+    w.put(cur_time);
+    w.put(packet::getLastPacketID());
+    w.put(next_seq);
+    w.put(stable_order);
+    node::save_all(w);
+    link::save_all(w);
+
+    vector<event *> &heap = events.container();
+    vector<event *> waiting = timers.waiting();
+    w.put<uint>(heap.size());
+    for (event *e : heap)
+    {
+        w.put_str(e->type());
+        w.put(e->trigger_time);
+        e->save(w);
+        w.put(e->cancelled);
+        w.put(e->seq);
+    }
+    w.put<uint>(waiting.size());
+    for (event *e : waiting)
+    {
+        w.put_str(e->type());
+        w.put(e->trigger_time);
+        e->save(w);
+        w.put(e->seq);
+    }
+    return w.write_to(path);
 }
-event *event::get_next_event()
+bool event::restore(const string &path)
 {
-    if (events.empty())
-        return nullptr;
-    event *e = events.top();
-    events.pop();
-    // cout << events.size() << " events remains" << endl;
-    return e;
+    snapshot_reader r;
+    if (!r.open(path))
+    {
+        cerr << "snapshot error: cannot open " << path << endl;
+        return false;
+    }
+    if (r.get_str() != "TRA_snapshot" || r.get<uint>() != 7)
+    {
+        cerr << "snapshot error: " << path << " is not a snapshot" << endl;
+        return false;
+    }
+    if (!events.empty() || timers.size() > 0)
+    {
+        cerr << "snapshot error: the event queue is not empty" << endl;
+        return false;
+    }
+    cur_time = r.get<uint>();
+    uint last_packet_id = r.get<uint>();
+    unsigned long long saved_seq = r.get<unsigned long long>();
+    stable_order = r.get<bool>(); // the heap below is ordered by it
+    if (!node::load_all(r) || !link::load_all(r))
+        return false;
+
+    // the heap is stored in its exact order, so the saved container is already a valid heap
+    vector<event *> &heap = events.container();
+    for (uint n = r.get<uint>(); n > 0 && r.ok(); n--)
+    {
+        event *e = event_generator::restore(r);
+        if (e == nullptr)
+        {
+            cerr << "snapshot error: broken event" << endl;
+            return false;
+        }
+        e->cancelled = r.get<bool>();
+        e->seq = r.get<unsigned long long>();
+        if (e->cancelled)
+            tombstones++;
+        heap.push_back(e);
+    }
+    // timer handles are not kept across a restore; the timers are scheduled again
+    for (uint n = r.get<uint>(); n > 0 && r.ok(); n--)
+    {
+        event *e = event_generator::restore(r);
+        if (e == nullptr)
+        {
+            cerr << "snapshot error: broken event" << endl;
+            return false;
+        }
+        e->seq = r.get<unsigned long long>();
+        add_event(e);
+    }
+    packet::setLastPacketID(last_packet_id);
+    next_seq = saved_seq;
+    return r.ok();
 }
-void event::start_simulate(uint _end_time)
+
+// the data_packet_event function is used to add an initial event
+void data_packet_event(uint src, uint dst, double f_size, uint t = 0, string msg = "default")
 {
-    if (_end_time < 0)
+    if (node::id_to_node(src) == nullptr || (dst != BROCAST_ID && node::id_to_node(dst) == nullptr))
     {
-        cerr << "you should give a possitive value of _end_time" << endl;
+        cerr << "src or dst is incorrect" << endl;
+        return;
         return;
     }
-    end_time = _end_time;
-    event *e;
-    e = event::get_next_event();
-    while (e != nullptr && e->trigger_time <= end_time)
+
+    TRA_data_pkt_gen_event::pkt_gen_data e_data;
+    e_data.src_id = src;
+    e_data.dst_id = dst;
+    e_data._size = f_size;
+    e_data.msg = msg;
+
+    // recv_event *e = dynamic_cast<recv_event*> ( event::event_generator::generate("recv_event",t, (void *)&e_data) );
+    event_handle h = event::event_generator::generate("TRA_data_pkt_gen_event", t, (void *)&e_data);
+    if (!h.valid())
+        cerr << "event type is incorrect" << endl;
+}
+
+// the TRA_ctrl_packet_event function is used to add an initial event
+
+void TRA_ctrl_packet_event(uint src, uint t = event::getCurTime(),
+                           string msg = "default")
+{
+    // 1st parameter: the source; the destination that want to broadcast a msg with counter 0 (i.e., match ID)
+    // 2nd parameter: time (optional)
+    // 3rd parameter: msg for debug information (optional)
+    if (node::id_to_node(src) == nullptr)
     {
-        if (cur_time <= e->trigger_time)
-            cur_time = e->trigger_time;
-        else
+        cerr << "id is incorrect" << endl;
+        return;
+    }
+
+    // uint src = con_id;
+    TRA_ctrl_pkt_gen_event::pkt_gen_data e_data;
+    e_data.src_id = src;
+    e_data.dst_id = BROCAST_ID;
+    // e_data.mat_id = mat;
+    // e_data.act_id = act;
+    e_data._size = 0; // we assume ctrl msg size is zero
+    e_data.msg = msg;
+    // e_data.per = per;
+
+    event_handle h = event::event_generator::generate("TRA_ctrl_pkt_gen_event", t, (void *)&e_data);
+    if (!h.valid())
+        cerr << "event type is incorrect" << endl;
+}
+
+// the TRA_ctrl_packet_periodic_event function is used to make src broadcast at t, t + period, ... up to until
+// only the next broadcast is kept in the timer wheel; each one schedules its successor when it fires
+void TRA_ctrl_packet_periodic_event(uint src, uint t, uint period, uint until, string msg = "default")
+{
+    if (node::id_to_node(src) == nullptr)
+    {
+        cerr << "id is incorrect" << endl;
+        return;
+    }
+    if (t > until)
+        return;
+
+    TRA_ctrl_pkt_gen_event::pkt_gen_data e_data;
+    e_data.src_id = src;
+    e_data.dst_id = BROCAST_ID;
+    e_data._size = 0; // we assume ctrl msg size is zero
+    e_data.msg = msg;
+    e_data.period = period;
+    e_data.until = until;
+
+    event_handle h = event::event_generator::generate("TRA_ctrl_pkt_gen_event", t, (void *)&e_data);
+    if (!h.valid())
+        cerr << "event type is incorrect" << endl;
+}
+
+// traffic_source streams the flows of a --traffic file, which has the lines of the input's flow section sorted by time;
+// the flows are injected by a traffic_pump_event window time units ahead, so only the flows starting within the window
+// are in the event queue instead of all of them
+class traffic_source
+{
+    static input_scanner in;
+    static uint window;
+    static bool opened;
+    // the next flow, read ahead to know when it starts
+    static bool has_next;
+    static size_t next_pos;
+    static uint next_src, next_dst, next_time;
+    static double next_size;
+
+    static void read_next();
+
+public:
+    static bool open(const string &path, uint _window);
+    // the start time of the next flow, or UINT_MAX if there is none
+    static uint first_time() { return has_next ? next_time : UINT_MAX; }
+    // inject the flows starting at or before until and schedule the pump for the ones after them
+    static void pump(uint until);
+    static void start() { pump(uint(min((unsigned long long)first_time() + window, (unsigned long long)UINT_MAX))); }
+    static uint getWindow() { return window; }
+    // the position of the next flow, for checkpointing
+    static size_t tell() { return has_next ? next_pos : in.size(); }
+    static bool seek(size_t pos);
+};
+input_scanner traffic_source::in;
+uint traffic_source::window = 1;
+bool traffic_source::opened = false;
+bool traffic_source::has_next = false;
+size_t traffic_source::next_pos = 0;
+uint traffic_source::next_src = 0;
+uint traffic_source::next_dst = 0;
+uint traffic_source::next_time = 0;
+double traffic_source::next_size = 0;
+
+// traffic_pump_event prints nothing, so streaming the flows does not change the log
+class traffic_pump_event : public event
+{
+    traffic_pump_event(traffic_pump_event &) : event() {}
+    traffic_pump_event() {} // we don't allow users to new a traffic_pump_event by themselves
+    size_t pos;             // where the source continues; only used to restore it from a snapshot
+
+protected:
+    // this constructor cannot be directly called by users; only by generator
+    traffic_pump_event(uint _trigger_time, void *data) : event(_trigger_time), pos(*(size_t *)data) {}
+
+public:
+    virtual ~traffic_pump_event() {}
+    virtual void trigger();
+
+    uint event_priority() const;
+
+    string type() { return "traffic_pump_event"; }
+    void save(snapshot_writer &w) const { w.put(pos); }
+
+    class traffic_pump_event_generator;
+    friend class traffic_pump_event_generator;
+    // traffic_pump_event is derived from event_generator to generate a event
+    class traffic_pump_event_generator : public event_generator
+    {
+        static traffic_pump_event_generator sample;
+        // this constructor is only for sample to register this event type
+        traffic_pump_event_generator() { register_event_type(&sample); }
+
+    protected:
+        virtual event *generate(uint _trigger_time, void *data)
         {
-            cerr << "cur_time = " << cur_time << ", event trigger_time = " << e->trigger_time << endl;
-            break;
+            return new traffic_pump_event(_trigger_time, data);
+        }
+        virtual event *restore(uint _trigger_time, snapshot_reader &r)
+        {
+            size_t _pos = r.get<size_t>();
+            if (!r.ok() || !traffic_source::seek(_pos))
+                return nullptr;
+            return new traffic_pump_event(_trigger_time, (void *)&_pos);
         }
 
-        // cout << "event trigger_time = " << e->trigger_time << endl;
-        e->print(); // for log
-        // cout << " event begin" << endl;
-        e->trigger();
-        // cout << " event end" << endl;
-        delete e;
-        e = event::get_next_event();
+    public:
+        virtual string type() { return "traffic_pump_event"; }
+        ~traffic_pump_event_generator() {}
+    };
+
+    void print() const {}
+};
+traffic_pump_event::traffic_pump_event_generator traffic_pump_event::traffic_pump_event_generator::sample;
+
+void traffic_pump_event::trigger()
+{
+    traffic_source::pump(uint(min((unsigned long long)trigger_time + traffic_source::getWindow(), (unsigned long long)UINT_MAX)));
+}
+uint traffic_pump_event::event_priority() const
+{
+    string string_for_hash;
+    string_for_hash = to_string(getTriggerTime()) + "traffic";
+    return get_hash_value(string_for_hash);
+}
+
+bool traffic_source::open(const string &path, uint _window)
+{
+    if (!in.open(path))
+    {
+        cerr << "cannot open the traffic file " << path << endl;
+        return false;
     }
-    // cout << "no more event" << endl;
+    opened = true;
+    window = max(_window, 1u);
+    read_next();
+    return true;
 }
 
-bool mycomp::operator()(const event *lhs, const event *rhs) const
+void traffic_source::read_next()
 {
-    // cout << lhs->getTriggerTime() << ", " << rhs->getTriggerTime() << endl;
-    // cout << lhs->type() << ", " << rhs->type() << endl;
-    uint lhs_pri = lhs->event_priority();
-    uint rhs_pri = rhs->event_priority();
-    // cout << "lhs hash = " << lhs_pri << endl;
-    // cout << "rhs hash = " << rhs_pri << endl;
+    uint last_time = has_next ? next_time : 0;
+    has_next = false;
+    if (in.at_end())
+        return;
+    next_pos = in.tell();
+    uint id;
+    in >> id >> next_src >> next_dst >> next_size >> next_time;
+    if (!in.ok())
+    {
+        cerr << "the traffic file is broken at byte " << next_pos << endl;
+        return;
+    }
+    if (next_time < last_time)
+    {
+        // a flow in the past of the pump cannot be scheduled any more
+        cerr << "the traffic file is not sorted by time at byte " << next_pos << "; the rest of it is ignored" << endl;
+        return;
+    }
+    has_next = true;
+}
 
-    if (reverse)
-        return ((lhs->getTriggerTime()) == (rhs->getTriggerTime())) ? (lhs_pri < rhs_pri) : ((lhs->getTriggerTime()) < (rhs->getTriggerTime()));
-    else
-        return ((lhs->getTriggerTime()) == (rhs->getTriggerTime())) ? (lhs_pri > rhs_pri) : ((lhs->getTriggerTime()) > (rhs->getTriggerTime()));
+void traffic_source::pump(uint until)
+{
+    while (has_next && next_time <= until)
+    {
+        data_packet_event(next_src, next_dst, next_size, next_time);
+        read_next();
+    }
+    if (!has_next)
+        return;
+    // the pump fires before the next flow, so the flow is queued before any event at its time is handled
+    uint t = max(until, next_time - min(next_time, window));
+    size_t pos = next_pos;
+    event_handle h = event::event_generator::generate("traffic_pump_event", t, (void *)&pos);
+    if (!h.valid())
+        cerr << "event type is incorrect" << endl;
 }
 
-class recv_event : public event
+bool traffic_source::seek(size_t pos)
+{
+    if (!opened)
+    {
+        cerr << "the snapshot streams its flows from a traffic file; please give the same --traffic" << endl;
+        return false;
+    }
+    in.seek(pos);
+    has_next = false;
+    read_next();
+    return true;
+}
+
+// traffic_model generates synthetic flows inside the simulator (--synthetic); every switch is a source whose
+// next flow is drawn only when its previous one is queued, so a long run needs neither a flow file nor a full queue
+//   arrival=poisson|onoff  rate=<flows per time unit of a source>  on=<mean on time>  off=<mean off time>
+//   matrix=uniform|gravity|hotspot  hotspots=<count>  hot=<share of flows to the hotspots>
+//   size=fixed|exp|pareto  mean=<size>  alpha=<pareto shape>  min=<pareto scale>
+//   seed=<n>  start=<t>  until=<t>
+// with gravity, the flows between s and d are proportional to the capacities attached to s and d
+class traffic_model
 {
 public:
-    class recv_data; // forward declaration
+    // the state of one source; it is also what a synthetic_flow_event saves
+    struct source_state
+    {
+        uint src = 0;
+        splitmix64 rng;
+        bool on = true;      // onoff: whether the source is in an on period
+        double phase_end = 0; // onoff: when the current on period ends
+        double time = 0;      // the arrival time of the queued flow, before rounding
+    };
 
 private:
-    recv_event(recv_event &) {} // this constructor cannot be used
-    recv_event() {}             // we don't allow users to new a recv_event by themselv
-    uint senderID;              // the sender
-    uint receiverID;            // the receiver; the packet will be given to the receiver
-    packet *pkt;                // the packet
+    enum arrival_model { POISSON, ONOFF };
+    enum matrix_model { UNIFORM, GRAVITY, HOTSPOT };
+    enum size_model { FIXED, EXP, PARETO };
+    // the parsed spec; configure fills it once, so a draw does no lookups
+    struct config
+    {
+        arrival_model arrival = POISSON;
+        matrix_model matrix = UNIFORM;
+        size_model size = FIXED;
+        double rate = 0.01, on = 100, off = 100, hotspots = 1, hot = 0.5, mean = 5;
+        double alpha = 1.5, min = 1, seed = 1, start = 0, until = 0;
+    };
+
+    static bool configured;
+    static config cfg;
+    static vector<uint> ids;
+    static vector<double> weights; // cumulative gravity weights over ids
+    static vector<uint> hotspots;
+
+    static uint pick(splitmix64 &rng, uint src);
+    static double draw_size(splitmix64 &rng);
+    static void draw_time(source_state &st);
+
+public:
+    // parse a comma-separated list of key=value; false on an unknown key or value
+    static bool configure(const string &spec, uint simulate_time);
+    static bool isConfigured() { return configured; }
+    static uint getStart() { return uint(cfg.start); }
+    // queue the first flow of every source
+    static void start();
+    // queue the next flow of st's source after the one at st.time, and the event drawing the one after it
+    static void next(source_state st);
+};
+bool traffic_model::configured = false;
+traffic_model::config traffic_model::cfg;
+vector<uint> traffic_model::ids;
+vector<double> traffic_model::weights;
+vector<uint> traffic_model::hotspots;
+
+// synthetic_flow_event prints nothing; the flow it queued prints its own line when it is generated
+class synthetic_flow_event : public event
+{
+    synthetic_flow_event(synthetic_flow_event &) : event() {}
+    synthetic_flow_event() {} // we don't allow users to new a synthetic_flow_event by themselves
+    traffic_model::source_state state;
 
 protected:
     // this constructor cannot be directly called by users; only by generator
-    recv_event(uint _trigger_time, void *data) : event(_trigger_time), senderID(BROCAST_ID), receiverID(BROCAST_ID), pkt(nullptr)
-    {
-        recv_data *data_ptr = (recv_data *)data;
-        senderID = data_ptr->s_id;
-        receiverID = data_ptr->r_id; // the packet will be given to the receiver
-        pkt = data_ptr->_pkt;
-    }
+    synthetic_flow_event(uint _trigger_time, void *data) : event(_trigger_time), state(*(traffic_model::source_state *)data) {}
 
 public:
-    virtual ~recv_event() {}
-    // recv_event will trigger the recv function
-    virtual void trigger();
+    virtual ~synthetic_flow_event() {}
+    virtual void trigger() { traffic_model::next(state); }
 
     uint event_priority() const;
 
-    class recv_event_generator;
-    friend class recv_event_generator;
-    // recv_event is derived from event_generator to generate a event
-    class recv_event_generator : public event_generator
+    string type() { return "synthetic_flow_event"; }
+    void save(snapshot_writer &w) const
     {
-        static recv_event_generator sample;
+        w.put(state.src);
+        w.put(state.rng.getState());
+        w.put(state.on);
+        w.put(state.phase_end);
+        w.put(state.time);
+    }
+
+    class synthetic_flow_event_generator;
+    friend class synthetic_flow_event_generator;
+    // synthetic_flow_event is derived from event_generator to generate a event
+    class synthetic_flow_event_generator : public event_generator
+    {
+        static synthetic_flow_event_generator sample;
         // this constructor is only for sample to register this event type
-        recv_event_generator() { /*cout << "recv_event registered" << endl;*/ register_event_type(&sample); }
+        synthetic_flow_event_generator() { register_event_type(&sample); }
 
     protected:
         virtual event *generate(uint _trigger_time, void *data)
         {
-            // cout << "recv_event generated" << endl;
-            return new recv_event(_trigger_time, data);
+            return new synthetic_flow_event(_trigger_time, data);
+        }
+        virtual event *restore(uint _trigger_time, snapshot_reader &r)
+        {
+            traffic_model::source_state st;
+            st.src = r.get<uint>();
+            st.rng = splitmix64(r.get<unsigned long long>());
+            st.on = r.get<bool>();
+            st.phase_end = r.get<double>();
+            st.time = r.get<double>();
+            if (!r.ok())
+                return nullptr;
+            if (!traffic_model::isConfigured())
+            {
+                cerr << "the snapshot has synthetic flows; please give the same --synthetic" << endl;
+                return nullptr;
+            }
+            return new synthetic_flow_event(_trigger_time, (void *)&st);
         }
 
     public:
-        virtual string type() { return "recv_event"; }
-        ~recv_event_generator() {}
-    };
-    // this class is used to initialize the recv_event
-    class recv_data
-    {
-    public:
-        uint s_id;
-        uint r_id;
-        packet *_pkt;
+        virtual string type() { return "synthetic_flow_event"; }
+        ~synthetic_flow_event_generator() {}
     };
 
-    void print() const;
+    void print() const {}
 };
-recv_event::recv_event_generator recv_event::recv_event_generator::sample;
+synthetic_flow_event::synthetic_flow_event_generator synthetic_flow_event::synthetic_flow_event_generator::sample;
 
-void recv_event::trigger()
+uint synthetic_flow_event::event_priority() const
+{
+    string string_for_hash;
+    string_for_hash = to_string(getTriggerTime()) + to_string(state.src) + "synthetic";
+    return get_hash_value(string_for_hash);
+}
+
+bool traffic_model::configure(const string &spec, uint simulate_time)
+{
+    cfg = config();
+    cfg.until = simulate_time;
+    // the value names are in enum order
+    const map<string, vector<string>> choices = {{"arrival", {"poisson", "onoff"}},
+                                                 {"matrix", {"uniform", "gravity", "hotspot"}},
+                                                 {"size", {"fixed", "exp", "pareto"}}};
+    map<string, int> picked = {{"arrival", POISSON}, {"matrix", UNIFORM}, {"size", FIXED}};
+    // these are converted to uint (or the time of a flow is), so a larger value is rejected
+    const vector<string> integral = {"hotspots", "seed", "start", "until"};
+    const map<string, double *> args = {{"rate", &cfg.rate}, {"on", &cfg.on}, {"off", &cfg.off},
+                                        {"hotspots", &cfg.hotspots}, {"hot", &cfg.hot}, {"mean", &cfg.mean},
+                                        {"alpha", &cfg.alpha}, {"min", &cfg.min}, {"seed", &cfg.seed},
+                                        {"start", &cfg.start}, {"until", &cfg.until}};
+    map<string, string> options;
+    parse_options(spec, options);
+    for (auto &option : options)
+    {
+        const string &key = option.first, &value = option.second;
+        if (choices.find(key) != choices.end())
+        {
+            const vector<string> &c = choices.at(key);
+            auto it = find(c.begin(), c.end(), value);
+            if (it == c.end())
+            {
+                cerr << "unknown synthetic " << key << " " << value << endl;
+                return false;
+            }
+            picked[key] = int(it - c.begin());
+            continue;
+        }
+        char *value_end = nullptr;
+        double v = strtod(value.c_str(), &value_end);
+        if (args.find(key) == args.end() || value.empty() || *value_end != '\0' || !isfinite(v) || v < 0 ||
+            (find(integral.begin(), integral.end(), key) != integral.end() && v > UINT_MAX))
+        {
+            cerr << "unknown or invalid synthetic option " << key << "=" << value << endl;
+            return false;
+        }
+        *args.at(key) = v;
+    }
+    cfg.arrival = arrival_model(picked["arrival"]);
+    cfg.matrix = matrix_model(picked["matrix"]);
+    cfg.size = size_model(picked["size"]);
+    // an onoff source with no on time would redraw its off periods forever
+    if (cfg.arrival == ONOFF && cfg.on <= 0)
+    {
+        cerr << "invalid synthetic option on=" << cfg.on << "; onoff needs on > 0" << endl;
+        return false;
+    }
+
+    ids = node::getNodeIDs();
+    weights.clear();
+    double total = 0;
+    for (uint id : ids)
+    {
+        double w = 0;
+        for (auto &nb : node::id_to_node(id)->getPhyNeighbors())
+        {
+            simple_link *l = dynamic_cast<simple_link *>(node::id_to_node(id)->getLink(nb.first));
+            w += (l != nullptr) ? l->getCapacity() : 1;
+        }
+        weights.push_back(total += w);
+    }
+    // the hotspots are drawn from the seed, so they are the same in every run
+    hotspots.clear();
+    splitmix64 rng((unsigned long long)cfg.seed * 0x9E3779B97F4A7C15ULL);
+    vector<uint> candidates = ids;
+    for (uint k = 0; k < uint(cfg.hotspots) && !candidates.empty(); k++)
+    {
+        uint i = rng.below(candidates.size());
+        hotspots.push_back(candidates[i]);
+        candidates.erase(candidates.begin() + i);
+    }
+    configured = true;
+    return true;
+}
+
+uint traffic_model::pick(splitmix64 &rng, uint src)
+{
+    if (ids.size() < 2)
+        return src;
+    if (cfg.matrix == HOTSPOT && !hotspots.empty() && rng.uniform() <= cfg.hot)
+    {
+        uint d = hotspots[rng.below(hotspots.size())];
+        if (d != src)
+            return d;
+    }
+    // the gravity draws give up after a while in case all the weight is on src
+    for (uint tries = 0;; tries++)
+    {
+        uint i;
+        if (cfg.matrix == GRAVITY && weights.back() > 0 && tries < 64)
+            i = min(uint(lower_bound(weights.begin(), weights.end(), rng.uniform() * weights.back()) - weights.begin()), uint(ids.size() - 1));
+        else
+            i = rng.below(ids.size());
+        if (ids[i] != src)
+            return ids[i];
+    }
+}
+
+double traffic_model::draw_size(splitmix64 &rng)
+{
+    if (cfg.size == EXP)
+        return rng.exponential(cfg.mean);
+    if (cfg.size == PARETO)
+        return cfg.min / pow(rng.uniform(), 1 / max(cfg.alpha, 1e-9));
+    return cfg.mean;
+}
+
+void traffic_model::draw_time(source_state &st)
+{
+    double rate = cfg.rate;
+    if (cfg.matrix == GRAVITY && weights.back() > 0)
+    {
+        // the source's share of the total weight, so the mean rate of all sources stays the same
+        uint i = lower_bound(ids.begin(), ids.end(), st.src) - ids.begin();
+        rate *= (weights[i] - (i > 0 ? weights[i - 1] : 0)) * ids.size() / weights.back();
+    }
+    if (rate <= 0)
+    {
+        st.time = HUGE_VAL;
+        return;
+    }
+    st.time += st.rng.exponential(1 / rate);
+    // the arrivals are memoryless, so the ones falling into an off period are drawn again from the next on period
+    while (cfg.arrival == ONOFF && st.time > st.phase_end)
+    {
+        double on_start = st.phase_end + st.rng.exponential(cfg.off);
+        st.phase_end = on_start + st.rng.exponential(cfg.on);
+        st.time = on_start + st.rng.exponential(1 / rate);
+    }
+}
+
+void traffic_model::start()
+{
+    for (uint id : ids)
+    {
+        source_state st;
+        st.src = id;
+        st.rng = splitmix64(((unsigned long long)cfg.seed << 32 | id) * 0xD1B54A32D192ED03ULL);
+        st.time = cfg.start;
+        st.phase_end = st.time + st.rng.exponential(cfg.on);
+        draw_time(st);
+        next(st);
+    }
+}
+
+void traffic_model::next(source_state st)
+{
+    if (st.time > cfg.until)
+        return;
+    uint t = uint(st.time);
+    data_packet_event(st.src, pick(st.rng, st.src), draw_size(st.rng), t, "synthetic");
+    // the following flow is drawn when this one is generated, so each source has one flow in the queue
+    draw_time(st);
+    event_handle h = event::event_generator::generate("synthetic_flow_event", t, (void *)&st);
+    if (!h.valid())
+        cerr << "event type is incorrect" << endl;
+}
+
+link *node::getLink(uint nb_id)
+{
+    return link::id_id_to_link(getNodeID(), nb_id);
+}
+
+// send_handler function is used to transmit packet p based on the information in the header
+// Note that the packet p will not be discard after send_handler ()
+void node::send_handler(packet *p)
+{
+    packet *_p = packet::packet_generator::replicate(p);
+    send_event::send_data e_data;
+    e_data.s_id = _p->getHeader()->getPreID();
+    e_data.r_id = _p->getHeader()->getNexID();
+    e_data._pkt = _p;
+    event_handle h = event::event_generator::generate("send_event", event::getCurTime(), (void *)&e_data);
+    if (!h.valid())
+        cerr << "event type is incorrect" << endl;
+}
+
+void send_event::trigger()
 {
     if (pkt == nullptr)
     {
-        cerr << "recv_event error: no pkt!" << endl;
+        cerr << "send_event error: no pkt!" << endl;
         return;
     }
-    else if (node::id_to_node(receiverID) == nullptr)
+    else if (node::id_to_node(senderID) == nullptr)
     {
-        cerr << "recv_event error: no node " << receiverID << "!" << endl;
-        delete pkt;
+        cerr << "send_event error: no node " << senderID << "!" << endl;
+        packet::discard(pkt);
+        return;
+    }
+    packet *p = pkt;
+    pkt = nullptr; // the node takes the packet
+    node *n = node::id_to_node(senderID);
+    bool metrics = sim_metrics::isEnabled();
+    node_profiler::profile *f = node_profiler::isEnabled() ? &node_profiler::of(senderID) : nullptr;
+    if (!metrics && f == nullptr)
+    {
+        n->send(p);
         return;
     }
-    node::id_to_node(receiverID)->recv(pkt);
+    // node::send is left as it is, so what it will do on each link is worked out before it runs:
+    // a link with room gets a replica, and one without is a drop
+    uint nex_id = p->getHeader()->getNexID();
+    double pkt_size = p->getSize();
+    if (f != nullptr)
+        f->send_events++;
+    for (auto &nb : n->getPhyNeighbors())
+    {
+        if (nb.first != nex_id && nex_id != BROCAST_ID)
+            continue;
+        if (!n->getLink(nb.first)->canTransmit({{"pkt_size", pkt_size}}))
+        {
+            if (metrics)
+                sim_metrics::mine().send_drops++;
+        }
+        else if (f != nullptr)
+        {
+            f->replicas++;
+            f->bytes_replicated += pkt_size;
+        }
+    }
+    unsigned long long t0 = metrics ? sim_metrics::now_ns() : 0;
+    n->send(p);
+    if (metrics)
+        sim_metrics::mine().send_ns.record(sim_metrics::now_ns() - t0);
 }
-uint recv_event::event_priority() const
+
+void node::send(packet *p)
+{ // this function is called by event; not for the user; you cannot change the send function
+    if (p == nullptr)
+        return;
+
+    uint _nexID = p->getHeader()->getNexID();
+    for (map<uint, bool>::iterator it = phy_neighbors.begin(); it != phy_neighbors.end(); it++)
+    {
+        uint nb_id = it->first; // neighbor id
+
+        if (nb_id != _nexID && BROCAST_ID != _nexID)
+            continue; // this neighbor will not receive the packet
+
+        link *l = link::id_id_to_link(id, nb_id);
+        // if ( !l ) continue; // no such a link
+
+        double pkt_size = p->getSize();
+        if (!(l->canTransmit({{"pkt_size", pkt_size}})))
+            continue; // if the capacity is insufficient, drop the packet
+        l->reserve({{"pkt_size", pkt_size}});
+
+        uint trigger_time = event::getCurTime() + link::id_id_to_link(id, nb_id)->getLatency(); // we simply assume that the delay is fixed
+        // cout << "node " << id << " send to node " << nb_id << endl;
+        recv_event::recv_data e_data;
+        e_data.s_id = id;    // set the sender   (i.e., preID)
+        e_data.r_id = nb_id; // set the receiver (i.e., nexID)
+
+        packet *p2 = packet::packet_generator::replicate(p);
+        e_data._pkt = p2;
+
+        recv_event *e = dynamic_cast<recv_event *>(event::event_generator::generate_event("recv_event", trigger_time, (void *)&e_data)); // send the packet to the neighbor
+        if (e == nullptr)
+            cerr << "event type is incorrect" << endl;
+    }
+    packet::discard(p);
+}
+
+double TRA_switch::getCapacity(uint nb_id)
 {
-    string string_for_hash;
-    string_for_hash = to_string(getTriggerTime()) + to_string(senderID) + to_string(receiverID) + to_string(pkt->getPacketID());
-    return get_hash_value(string_for_hash);
+    simple_link *l = dynamic_cast<simple_link *>(getLink(nb_id));
+    if (l)
+        return l->getCapacity();
+    return 0;
 }
-// the recv_event::print() function is used for log file
-void recv_event::print() const
+double TRA_switch::getOccupied(uint nb_id)
 {
-    cout << "time " << setw(11) << event::getCurTime()
-         << "   recID" << setw(11) << receiverID
-         << "   pktID" << setw(11) << pkt->getPacketID()
-         << "   srcID" << setw(11) << pkt->getHeader()->getSrcID()
-         << "   dstID" << setw(11) << pkt->getHeader()->getDstID()
-         << "   preID" << setw(11) << pkt->getHeader()->getPreID()
-         << "   nexID" << setw(11) << pkt->getHeader()->getNexID()
-         << "   " << pkt->type()
-         << pkt->addition_information();
-    //  if ( pkt->type() == "TRA_ctrl_packet" ) cout << "   " << ((TRA_ctrl_payload*)pkt->getPayload())->getCounter();
-    cout << endl;
-    // cout << pkt->type()
-    //      << "   time "       << setw(11) << event::getCurTime()
-    //      << "   recID "      << setw(11) << receiverID
-    //      << "   pktID"       << setw(11) << pkt->getPacketID()
-    //      << "   srcID "      << setw(11) << pkt->getHeader()->getSrcID()
-    //      << "   dstID"       << setw(11) << pkt->getHeader()->getDstID()
-    //      << "   preID"       << setw(11) << pkt->getHeader()->getPreID()
-    //      << "   nexID"       << setw(11) << pkt->getHeader()->getNexID()
-    //      << endl;
+    simple_link *l = dynamic_cast<simple_link *>(getLink(nb_id));
+    if (l)
+        return l->getOccupied();
+    return 0;
 }
 
-class send_event : public event
+void TRA_switch::save(snapshot_writer &w) const
 {
-public:
-    class send_data; // forward declaration
+    uint n_heard = 0, n_links = 0, n_seq = 0, n_stale = 0;
+    for (const origin_state &o : origins)
+    {
+        n_heard += o.heard;
+        if (o.block != link_state_db::NO_BLOCK)
+            n_links += link_state_db::adjacencies(o.block).size();
+        n_seq += o.seq_heard;
+        n_stale += o.stale;
+    }
+    w.put(n_heard);
+    for (uint src_id = 0; src_id < origins.size(); src_id++)
+        if (origins[src_id].heard)
+        {
+            w.put(src_id);
+            w.put(origins[src_id].last_p_id);
+        }
+    w.put(n_entry_origins);
+    for (uint src_id = 0; src_id < origins.size(); src_id++)
+        if (!origins[src_id].entries.empty())
+        {
+            w.put(src_id);
+            w.put<uint>(origins[src_id].entries.size());
+            for (uint pre_id : origins[src_id].entries)
+                w.put(pre_id);
+        }
+    w.put(n_links);
+    for (uint src_id = 0; src_id < origins.size(); src_id++)
+        if (origins[src_id].block != link_state_db::NO_BLOCK)
+            for (const link_state_db::adjacency &a : link_state_db::adjacencies(origins[src_id].block))
+            {
+                w.put(src_id);
+                w.put(a.nb_id);
+                w.put<double>(a.capacity);
+                w.put<double>(a.occupied);
+            }
+    w.put(lsa_seq);
+    w.put(n_seq);
+    for (uint src_id = 0; src_id < origins.size(); src_id++)
+        if (origins[src_id].seq_heard)
+        {
+            w.put(src_id);
+            w.put(origins[src_id].last_seq);
+        }
+    w.put(n_stale);
+    for (uint src_id = 0; src_id < origins.size(); src_id++)
+        if (origins[src_id].stale)
+            w.put(src_id);
+}
+void TRA_switch::load(snapshot_reader &r)
+{
+    for (origin_state &o : origins)
+        link_state_db::release(o.block);
+    origins.clear();
+    n_entry_origins = 0;
+    for (uint n = r.get<uint>(); n > 0 && r.ok(); n--)
+    {
+        origin_state &o = getOriginState(r.get<uint>());
+        o.heard = true;
+        o.last_p_id = r.get<uint>();
+    }
+    for (uint n = r.get<uint>(); n > 0 && r.ok(); n--)
+    {
+        uint src_id = r.get<uint>();
+        vector<uint> entries;
+        for (uint m = r.get<uint>(); m > 0 && r.ok(); m--)
+            entries.push_back(r.get<uint>());
+        set_entries(getOriginState(src_id), entries);
+    }
+    map<uint, map<uint, pair<double, double>>> learned;
+    for (uint n = r.get<uint>(); n > 0 && r.ok(); n--)
+    {
+        uint src_id = r.get<uint>();
+        uint nb_id = r.get<uint>();
+        double capacity = r.get<double>();
+        double occupied = r.get<double>();
+        learned[src_id][nb_id] = {capacity, occupied};
+    }
+    for (auto it = learned.begin(); it != learned.end(); it++)
+        learn(it->first, it->second, false);
+    lsa_seq = r.get<uint>();
+    for (uint n = r.get<uint>(); n > 0 && r.ok(); n--)
+    {
+        origin_state &o = getOriginState(r.get<uint>());
+        o.seq_heard = true;
+        o.last_seq = r.get<uint>();
+    }
+    for (uint n = r.get<uint>(); n > 0 && r.ok(); n--)
+        getOriginState(r.get<uint>()).stale = true;
+    if (spf_routing)
+        spf_rebuild();
+    fib_dirty = true;
+    link_state_version++;
+}
 
-private:
-    send_event(send_event &) {}
-    send_event() {} // we don't allow users to new a recv_event by themselves
-    // this constructor cannot be directly called by users; only by generator
-    uint senderID;   // the sender
-    uint receiverID; // the receiver
-    packet *pkt;     // the packet
+uint TRA_switch::neighbor_slot(uint nb_id)
+{
+    // the neighbors are fixed once the topology is built, so the slots are assigned on first use
+    if (nb_slots.size() != getPhyNeighbors().size())
+    {
+        nb_slots.clear();
+        nb_slots.reserve(getPhyNeighbors().size());
+        for (auto it = getPhyNeighbors().begin(); it != getPhyNeighbors().end(); it++)
+            nb_slots.insert({it->first, uint(nb_slots.size())});
+    }
+    auto slot = nb_slots.find(nb_id);
+    return (slot == nb_slots.end()) ? UINT_MAX : slot->second;
+}
 
-protected:
-    send_event(uint _trigger_time, void *data) : event(_trigger_time), senderID(BROCAST_ID), receiverID(BROCAST_ID), pkt(nullptr)
+bool TRA_switch::add_entry(origin_state &o, uint nb_id)
+{
+    uint slot = neighbor_slot(nb_id);
+    if (slot == UINT_MAX) // not a neighbor; fall back to a scan
+    {
+        if (find(o.entries.begin(), o.entries.end(), nb_id) != o.entries.end())
+            return false;
+    }
+    else if (slot < 64)
     {
-        send_data *data_ptr = (send_data *)data;
-        senderID = data_ptr->s_id;
-        receiverID = data_ptr->r_id;
-        pkt = data_ptr->_pkt;
+        unsigned long long bit = 1ULL << slot;
+        if (o.entry_bits & bit)
+            return false;
+        o.entry_bits |= bit;
+    }
+    else
+    {
+        uint word = slot / 64 - 1;
+        unsigned long long bit = 1ULL << (slot % 64);
+        if (word >= o.more_entry_bits.size())
+            o.more_entry_bits.resize(word + 1);
+        if (o.more_entry_bits[word] & bit)
+            return false;
+        o.more_entry_bits[word] |= bit;
     }
+    if (o.entries.empty())
+        n_entry_origins++;
+    o.entries.push_back(nb_id);
+    fib_dirty = true;
+    return true;
+}
 
-public:
-    virtual ~send_event() {}
-    // send_event will trigger the send function
-    virtual void trigger();
+void TRA_switch::set_entries(origin_state &o, const vector<uint> &entries)
+{
+    if (!o.entries.empty())
+        n_entry_origins--;
+    o.entries.clear();
+    o.entry_bits = 0;
+    o.more_entry_bits.clear();
+    fib_dirty = true;
+    for (uint nb_id : entries)
+        add_entry(o, nb_id);
+}
 
-    uint event_priority() const;
+void TRA_switch::install_origin(uint src_id, uint p_id, const vector<uint> &entries, const map<uint, pair<double, double>> &src_nbs)
+{
+    origin_state &o = getOriginState(src_id);
+    o.heard = true;
+    o.last_p_id = p_id;
+    if (src_id != getNodeID())
+        set_entries(o, entries);
+    learn(src_id, src_nbs, false);
+}
 
-    class send_event_generator;
-    friend class send_event_generator;
-    // send_event is derived from event_generator to generate a event
-    class send_event_generator : public event_generator
+void TRA_switch::learn(uint src_id, const map<uint, pair<double, double>> &updates, bool update_spf)
+{
+    uint base = getOriginState(src_id).block;
+    uint learned = link_state_db::apply(src_id, base, updates);
+    origins[src_id].block = learned;
+    const vector<link_state_db::adjacency> &adj = link_state_db::adjacencies(learned);
+    if (!adj.empty())
+        getOriginState(adj.back().nb_id); // so every node in a learned block has its origin_state
+    if (learned == base)
     {
-        static send_event_generator sample;
-        // this constructor is only for sample to register this event type
-        send_event_generator() { /*cout << "send_event registered" << endl;*/ register_event_type(&sample); }
+        link_state_db::release(base);
+        return;
+    }
+    fib_dirty = true;
+    link_state_version++;
+    if (spf_routing && update_spf)
+        spf_update(src_id, base);
+    link_state_db::release(base);
+}
 
-    protected:
-        virtual event *generate(uint _trigger_time, void *data)
-        {
-            // cout << "send_event generated" << endl;
-            return new send_event(_trigger_time, data);
-        }
+bool TRA_switch::spf_link(uint u, uint v) const
+{
+    pair<double, double> state;
+    return findLinkState(u, v, state) && state.first > 0;
+}
 
-    public:
-        virtual string type() { return "send_event"; }
-        ~send_event_generator() {}
-    };
-    // this class is used to initialize the send_event
-    class send_data
+// make u the parent of v if that is a shorter path or an equally short one through a smaller id
+void TRA_switch::spf_offer(uint u, uint v, spf_queue &q)
+{
+    if (v == getNodeID())
+        return;
+    uint d = origins[u].dist + 1;
+    if (d < origins[v].dist || (d == origins[v].dist && u < origins[v].parent))
     {
-    public:
-        uint s_id;
-        uint r_id;
-        packet *_pkt;
-        uint t;
-    };
+        origins[v].dist = d;
+        origins[v].parent = u;
+        origins[v].hop = (u == getNodeID()) ? v : origins[u].hop;
+        q.push({d, v});
+    }
+}
 
-    void print() const;
-};
-send_event::send_event_generator send_event::send_event_generator::sample;
+// run Dijkstra from the nodes in q, also passing first-hop changes down to the children
+void TRA_switch::spf_settle(spf_queue &q)
+{
+    while (!q.empty())
+    {
+        pair<uint, uint> top = q.top();
+        q.pop();
+        uint x = top.second;
+        if (top.first != origins[x].dist || origins[x].block == link_state_db::NO_BLOCK)
+            continue;
+        for (const link_state_db::adjacency &a : link_state_db::adjacencies(origins[x].block))
+        {
+            if (a.capacity <= 0)
+                continue;
+            uint w = a.nb_id;
+            uint hop = (x == getNodeID()) ? w : origins[x].hop;
+            if (origins[w].parent == x && origins[w].dist == top.first + 1 && origins[w].hop != hop)
+            {
+                origins[w].hop = hop;
+                q.push({origins[w].dist, w});
+            }
+            else
+                spf_offer(x, w, q);
+        }
+    }
+}
 
-void send_event::trigger()
+void TRA_switch::spf_update(uint src_id, uint old_block)
 {
-    if (pkt == nullptr)
+    uint self = getNodeID();
+    if (getOriginState(self).dist != 0)
     {
-        cerr << "send_event error: no pkt!" << endl;
+        spf_rebuild();
         return;
     }
-    else if (node::id_to_node(senderID) == nullptr)
+
+    // the links of src_id that went away and the ones that came up
+    const vector<link_state_db::adjacency> none;
+    const vector<link_state_db::adjacency> &before = (old_block == link_state_db::NO_BLOCK) ? none : link_state_db::adjacencies(old_block);
+    const vector<link_state_db::adjacency> &after = link_state_db::adjacencies(origins[src_id].block);
+    vector<uint> removed, added;
+    auto b = before.begin(), a = after.begin();
+    while (b != before.end() || a != after.end())
     {
-        cerr << "send_event error: no node " << senderID << "!" << endl;
-        delete pkt;
+        if (a == after.end() || (b != before.end() && b->nb_id < a->nb_id))
+        {
+            if (b->capacity > 0)
+                removed.push_back(b->nb_id);
+            b++;
+        }
+        else if (b == before.end() || a->nb_id < b->nb_id)
+        {
+            if (a->capacity > 0)
+                added.push_back(a->nb_id);
+            a++;
+        }
+        else
+        {
+            if (b->capacity > 0 && a->capacity <= 0)
+                removed.push_back(b->nb_id);
+            else if (b->capacity <= 0 && a->capacity > 0)
+                added.push_back(a->nb_id);
+            a++, b++;
+        }
+    }
+    if (removed.empty() && added.empty())
         return;
+
+    // a removed tree link detaches the subtree under it
+    vector<uint> affected, pending;
+    for (uint v : removed)
+        if (origins[v].parent == src_id && v != self)
+            pending.push_back(v);
+    while (!pending.empty())
+    {
+        uint x = pending.back();
+        pending.pop_back();
+        affected.push_back(x);
+        if (origins[x].block != link_state_db::NO_BLOCK)
+            for (const link_state_db::adjacency &adj : link_state_db::adjacencies(origins[x].block))
+                if (origins[adj.nb_id].parent == x && adj.nb_id != self)
+                    pending.push_back(adj.nb_id);
+    }
+    for (uint x : affected)
+    {
+        origins[x].dist = UINT_MAX;
+        origins[x].parent = UINT_MAX;
+        origins[x].hop = UINT_MAX;
+    }
+
+    // re-attach each detached node to the rest of the tree; links are symmetric, so its predecessors are
+    // its own neighbors, unless the switch has not learned them yet
+    spf_queue q;
+    for (uint v : affected)
+    {
+        if (origins[v].block != link_state_db::NO_BLOCK)
+        {
+            for (const link_state_db::adjacency &adj : link_state_db::adjacencies(origins[v].block))
+                if (origins[adj.nb_id].dist != UINT_MAX && spf_link(adj.nb_id, v))
+                    spf_offer(adj.nb_id, v, q);
+        }
+        else
+            for (uint u = 0; u < origins.size(); u++)
+                if (origins[u].dist != UINT_MAX && spf_link(u, v))
+                    spf_offer(u, v, q);
     }
-    node::id_to_node(senderID)->send(pkt);
+    if (origins[src_id].dist != UINT_MAX)
+        for (uint v : added)
+            spf_offer(src_id, v, q);
+    spf_settle(q);
 }
-uint send_event::event_priority() const
+
+void TRA_switch::spf_rebuild()
 {
-    string string_for_hash;
-    string_for_hash = to_string(getTriggerTime()) + to_string(senderID) + to_string(receiverID) + to_string(pkt->getPacketID());
-    return get_hash_value(string_for_hash);
+    uint self = getNodeID();
+    getOriginState(self);
+    for (origin_state &o : origins)
+        o.dist = o.parent = o.hop = UINT_MAX;
+    origins[self].dist = 0;
+    origins[self].parent = self;
+    origins[self].hop = self;
+    spf_queue q;
+    q.push({0, self});
+    spf_settle(q);
 }
-// the send_event::print() function is used for log file
-void send_event::print() const
+
+uint TRA_switch::next_hop(uint dst_id) const
 {
-    cout << "time " << setw(11) << event::getCurTime()
-         << "   senID" << setw(11) << senderID
-         << "   pktID" << setw(11) << pkt->getPacketID()
-         << "   srcID" << setw(11) << pkt->getHeader()->getSrcID()
-         << "   dstID" << setw(11) << pkt->getHeader()->getDstID()
-         << "   preID" << setw(11) << pkt->getHeader()->getPreID()
-         << "   nexID" << setw(11) << pkt->getHeader()->getNexID()
-         << "   " << pkt->type()
-         << pkt->addition_information()
-         //<< "   msg"         << setw(11) << dynamic_cast<TRA_data_payload*>(pkt->getPayload())->getMsg()
-         << endl;
-    // cout << pkt->type()
-    //      << "   time "       << setw(11) << event::getCurTime()
-    //      << "   senID "      << setw(11) << senderID
-    //      << "   pktID"       << setw(11) << pkt->getPacketID()
-    //      << "   srcID "      << setw(11) << pkt->getHeader()->getSrcID()
-    //      << "   dstID"       << setw(11) << pkt->getHeader()->getDstID()
-    //      << "   preID"       << setw(11) << pkt->getHeader()->getPreID()
-    //      << "   nexID"       << setw(11) << pkt->getHeader()->getNexID()
-    //      << endl;
+    const origin_state *o = (dst_id < origins.size()) ? &origins[dst_id] : nullptr;
+    if (spf_routing && o != nullptr && o->hop != UINT_MAX)
+        return o->hop;
+    if (preset_width > 0 && dst_id < preset_routes.size() / preset_width && preset_routes[dst_id * preset_width] != UINT_MAX)
+        return preset_routes[dst_id * preset_width];
+    return (o == nullptr || o->entries.empty()) ? UINT_MAX : o->entries[0];
 }
 
-////////////////////////////////////////////////////////////////////////////////
-
-class TRA_data_pkt_gen_event : public event
+bool TRA_switch::findLinkState(uint src_id, uint nb_id, pair<double, double> &state) const
 {
-public:
-    class gen_data; // forward declaration
+    return src_id < origins.size() && link_state_db::find(origins[src_id].block, nb_id, state);
+}
 
-private:
-    TRA_data_pkt_gen_event(TRA_data_pkt_gen_event &) {}
-    TRA_data_pkt_gen_event() {} // we don't allow users to new a recv_event by themselves
-    // this constructor cannot be directly called by users; only by generator
-    uint src; // the src
-    uint dst; // the dst
-    double size;
-    // packet *pkt; // the packet
-    string msg;
+pair<double, double> TRA_switch::getLinkState(uint src_id, uint nb_id) const
+{
+    pair<double, double> state;
+    if (!findLinkState(src_id, nb_id, state))
+        throw out_of_range("TRA_switch::getLinkState");
+    return state;
+}
 
-protected:
-    TRA_data_pkt_gen_event(uint _trigger_time, void *data) : event(_trigger_time), src(BROCAST_ID), dst(BROCAST_ID)
+void TRA_switch::fast_forward_control_plane(uint t, uint num_threads)
+{
+    // index the switches densely and copy the topology into flat arrays
+    vector<TRA_switch *> sw;
+    map<uint, uint> idx;
+    for (uint id : node::getNodeIDs())
     {
-        pkt_gen_data *data_ptr = (pkt_gen_data *)data;
-        src = data_ptr->src_id;
-        dst = data_ptr->dst_id;
-        size = data_ptr->_size;
-        // pkt = data_ptr->_pkt;
-        msg = data_ptr->msg;
+        TRA_switch *s = dynamic_cast<TRA_switch *>(node::id_to_node(id));
+        if (s == nullptr)
+            continue;
+        idx[id] = sw.size();
+        sw.push_back(s);
     }
-
-public:
-    virtual ~TRA_data_pkt_gen_event() {}
-    // TRA_data_pkt_gen_event will trigger the packet gen function
-    virtual void trigger();
-
-    uint event_priority() const;
-
-    class TRA_data_pkt_gen_event_generator;
-    friend class TRA_data_pkt_gen_event_generator;
-    // TRA_data_pkt_gen_event_generator is derived from event_generator to generate an event
-    class TRA_data_pkt_gen_event_generator : public event_generator
+    uint n = sw.size();
+    vector<vector<pair<uint, uint>>> adj(n); // (neighbor index, latency)
+    vector<map<uint, pair<double, double>>> nbs(n);
+    for (uint i = 0; i < n; i++)
     {
-        static TRA_data_pkt_gen_event_generator sample;
-        // this constructor is only for sample to register this event type
-        TRA_data_pkt_gen_event_generator() { /*cout << "send_event registered" << endl;*/ register_event_type(&sample); }
-
-    protected:
-        virtual event *generate(uint _trigger_time, void *data)
+        const map<uint, bool> &nblist = sw[i]->getPhyNeighbors();
+        for (map<uint, bool>::const_iterator it = nblist.begin(); it != nblist.end(); it++)
         {
-            // cout << "send_event generated" << endl;
-            return new TRA_data_pkt_gen_event(_trigger_time, data);
+            link *l = sw[i]->getLink(it->first);
+            if (l == nullptr || idx.find(it->first) == idx.end())
+                continue;
+            adj[i].push_back({idx[it->first], l->getLatency()});
+            nbs[i][it->first] = {sw[i]->getCapacity(it->first), sw[i]->getOccupied(it->first)};
         }
+    }
 
-    public:
-        virtual string type() { return "TRA_data_pkt_gen_event"; }
-        ~TRA_data_pkt_gen_event_generator() {}
-    };
-    // this class is used to initialize the TRA_data_pkt_gen_event
-    class pkt_gen_data
+    // the generating events at time t fire in priority order, and each takes the next packet id
+    vector<uint> order(n), p_id(n);
+    for (uint i = 0; i < n; i++)
+        order[i] = i;
+    sort(order.begin(), order.end(), [&](uint a, uint b)
+         { return TRA_ctrl_pkt_gen_event::priority_of(t, sw[a]->getNodeID(), BROCAST_ID) < TRA_ctrl_pkt_gen_event::priority_of(t, sw[b]->getNodeID(), BROCAST_ID); });
+    uint first_id = packet::getLastPacketID();
+    for (uint i = 0; i < n; i++)
+        p_id[order[i]] = first_id + i;
+    packet::setLastPacketID(first_id + n);
+
+    // a switch relays a flood once, when it first receives it; so switch s gets a copy from every neighbor u
+    // at u's first-arrival time plus the link latency, and copies arriving together are ordered by their recv_event priority
+    vector<mutex> locks(n);
+    atomic<uint> next_origin(0);
+    auto worker = [&]()
     {
-    public:
-        uint src_id;
-        uint dst_id;
-        double _size;
-        string msg;
-        // packet *_pkt;
-    };
+        vector<uint> arrival(n);
+        vector<tuple<uint, uint, uint>> copies; // (arrival time, priority, neighbor id)
+        vector<uint> entries;
+        for (uint o = next_origin++; o < n; o = next_origin++)
+        {
+            fill(arrival.begin(), arrival.end(), UINT_MAX);
+            priority_queue<pair<uint, uint>, vector<pair<uint, uint>>, greater<pair<uint, uint>>> pq;
+            arrival[o] = t;
+            pq.push({t, o});
+            while (!pq.empty())
+            {
+                pair<uint, uint> top = pq.top();
+                pq.pop();
+                if (top.first != arrival[top.second])
+                    continue;
+                for (auto &e : adj[top.second])
+                    if (top.first + e.second < arrival[e.first])
+                    {
+                        arrival[e.first] = top.first + e.second;
+                        pq.push({arrival[e.first], e.first});
+                    }
+            }
 
-    void print() const;
-};
-TRA_data_pkt_gen_event::TRA_data_pkt_gen_event_generator TRA_data_pkt_gen_event::TRA_data_pkt_gen_event_generator::sample;
+            uint o_id = sw[o]->getNodeID();
+            for (uint s = 0; s < n; s++)
+            {
+                if (arrival[s] == UINT_MAX)
+                    continue;
+                entries.clear();
+                if (s != o)
+                {
+                    copies.clear();
+                    for (auto &e : adj[s])
+                        if (arrival[e.first] != UINT_MAX)
+                        {
+                            uint u_id = sw[e.first]->getNodeID();
+                            uint time = arrival[e.first] + e.second;
+                            copies.push_back(make_tuple(time, recv_event::priority_of(time, u_id, sw[s]->getNodeID(), p_id[o]), u_id));
+                        }
+                    sort(copies.begin(), copies.end());
+                    for (auto &c : copies)
+                        entries.push_back(get<2>(c));
+                }
+                lock_guard<mutex> guard(locks[s]);
+                sw[s]->install_origin(o_id, p_id[o], entries, nbs[o]);
+            }
+        }
+    };
+    vector<thread> pool;
+    for (uint i = 1; i < max(num_threads, 1u); i++)
+        pool.push_back(thread(worker));
+    worker();
+    for (thread &th : pool)
+        th.join();
+    for (TRA_switch *s : sw)
+        if (s->spf_routing)
+            s->spf_rebuild();
+}
 
-void TRA_data_pkt_gen_event::trigger()
+void TRA_switch::build_fib()
 {
-    if (node::id_to_node(src) == nullptr)
+    uint n_slots = getPhyNeighbors().size();
+    residual.assign(n_slots + 1, 0);
+    uint self = getNodeID();
+    residual_live = !(self < origins.size() && origins[self].block != link_state_db::NO_BLOCK);
+    if (!residual_live)
+        for (const link_state_db::adjacency &a : link_state_db::adjacencies(origins[self].block))
+        {
+            uint slot = neighbor_slot(a.nb_id);
+            if (slot != UINT_MAX)
+                residual[slot] = double(a.capacity) - double(a.occupied);
+        }
+    else // preset routes can be used before this switch advertises its own links; route_data then reads the links live
+        for (auto it = getPhyNeighbors().begin(); it != getPhyNeighbors().end(); it++)
+            residual[neighbor_slot(it->first)] = getCapacity(it->first) - getOccupied(it->first);
+    auto slot_of = [&](uint nb_id)
     {
-        cerr << "TRA_data_pkt_gen_event error: no node " << src << "!" << endl;
-        return;
-    }
-    else if (dst != BROCAST_ID && node::id_to_node(dst) == nullptr)
+        uint slot = neighbor_slot(nb_id);
+        return (slot == UINT_MAX) ? n_slots : slot;
+    };
+
+    uint n_preset = (preset_width > 0) ? preset_routes.size() / preset_width : 0;
+    fib.assign(max<size_t>(origins.size(), n_preset), fib_entry());
+    fib_alts.clear();
+    for (uint dst_id = 0; dst_id < fib.size(); dst_id++)
     {
-        cerr << "TRA_data_pkt_gen_event error: no node " << dst << "!" << endl;
-        return;
+        fib_entry &route = fib[dst_id];
+        route.next_hop = next_hop(dst_id);
+        route.slot = (route.next_hop == UINT_MAX) ? n_slots : slot_of(route.next_hop); // no link to look up for an unknown destination
+        route.alt_begin = fib_alts.size();
+        if (dst_id < n_preset && preset_routes[dst_id * preset_width] != UINT_MAX)
+        {
+            for (uint i = 0; i < preset_width && preset_routes[dst_id * preset_width + i] != UINT_MAX; i++)
+                fib_alts.push_back({preset_routes[dst_id * preset_width + i], slot_of(preset_routes[dst_id * preset_width + i])});
+        }
+        else if (dst_id < origins.size())
+        {
+            const vector<uint> &entries = origins[dst_id].entries;
+            for (uint i = 0; i < entries.size() && i <= entries.size() / 2; i++)
+                fib_alts.push_back({entries[i], slot_of(entries[i])});
+        }
+        route.alt_end = fib_alts.size();
     }
+    fib_dirty = false;
+    route_version++;
+}
 
-    TRA_data_packet *pkt = dynamic_cast<TRA_data_packet *>(packet::packet_generator::generate("TRA_data_packet"));
-    if (pkt == nullptr)
+uint TRA_switch::route_data(TRA_data_header *h4, double size, route_choice *choice)
+{
+    if (fib_dirty)
+        build_fib();
+    route_choice made = ROUTE_OTHER;
+    if (choice == nullptr)
+        choice = &made;
+    *choice = ROUTE_UNKNOWN;
+    uint dst_id = h4->getDstID();
+    uint top_id = h4->get_label(); // get top label from the header
+    if (top_id >= fib.size() || dst_id >= fib.size() || fib[top_id].next_hop == UINT_MAX) // unknown destination
+        return UINT_MAX;
+    const fib_entry &route = fib[top_id];
+    uint next_id = route.next_hop;
+    *choice = ROUTE_PRIMARY;
+
+    if (!fits(route.slot, next_id, size)) // capacity not enough
     {
-        cerr << "packet type is incorrect" << endl;
-        return;
+        // find another path
+        *choice = ROUTE_OTHER;
+        if (h4->get_used_labels() < getNumOfLabel() - 1) // check #labels
+        {
+            // add label
+            const fib_entry &dst_route = fib[dst_id];
+            uint primary = dst_route.next_hop;
+            uint label = primary;
+            const cspf_route *detour = cspf_routing ? cspf_find(top_id, size, h4) : nullptr;
+            if (detour != nullptr && detour->path.size() > 1 && cspf_fits(detour->labels, h4))
+            {
+                if (detour != &cspf_scratch) // the route of the whole size class
+                    *choice = ROUTE_CSPF;
+                for (auto it = detour->labels.rbegin(); it != detour->labels.rend(); it++)
+                    h4->push_label(*it);
+                next_id = detour->path[1];
+            }
+            else
+            {
+                for (uint i = dst_route.alt_begin; i < dst_route.alt_end; i++)
+                {
+                    uint nb = fib_alts[i].first;
+                    // find nb with enough capacity; the original scan wants more room than the size, which is kept without
+                    // cspf_routing so that the default output does not change
+                    bool enough = cspf_routing ? fits(fib_alts[i].second, nb, size) : room(fib_alts[i].second, nb) > size;
+                    if (nb != UINT_MAX && !h4->visited(nb) && enough)
+                    {
+                        label = nb;
+                        break;
+                    }
+                }
+
+                if (label != primary && label != UINT_MAX)
+                {
+                    h4->push_label(label);
+                    next_id = label;
+                }
+            }
+        }
+        else
+            return UINT_MAX;
     }
-    TRA_data_header *hdr = dynamic_cast<TRA_data_header *>(pkt->getHeader());
-    TRA_data_payload *pld = dynamic_cast<TRA_data_payload *>(pkt->getPayload());
 
-    if (hdr == nullptr)
+    if (next_id == UINT_MAX || h4->visited(next_id)) // an unreachable destination drops the packet
+        return UINT_MAX;
+    return next_id;
+}
+
+uint TRA_switch::route_from_source(TRA_data_header *h4, double size)
+{
+    if (fib_dirty)
+        build_fib();
+    uint dst_id = h4->getDstID();
+    source_route &cached = source_routes[{dst_id, size_class(size)}];
+    // the primary next hop must still have room for this size, or still lack it for a CSPF detour; the residual is
+    // checked again because the links are read live for preset routes
+    bool holds = false;
+    if (cached.version == route_version)
     {
-        cerr << "header type is incorrect" << endl;
-        return;
+        if (cached.choice == ROUTE_UNKNOWN)
+            holds = true;
+        else if (cached.choice == ROUTE_PRIMARY || cached.choice == ROUTE_CSPF)
+            holds = fits(fib[dst_id].slot, fib[dst_id].next_hop, size) == (cached.choice == ROUTE_PRIMARY);
     }
-    if (pld == nullptr)
+    if (holds)
     {
-        cerr << "payload type is incorrect" << endl;
-        return;
+        path_cache_hits++;
+        for (uint label : cached.labels)
+            h4->push_label(label);
+        return cached.next_id;
     }
+    if (cached.version != 0)
+        path_cache_invalidations++;
+    path_cache_misses++;
+
+    uint bottom = h4->get_num_labels();
+    cached.version = route_version;
+    cached.next_id = route_data(h4, size, &cached.choice);
+    cached.labels.clear();
+    for (uint i = bottom; i < h4->get_num_labels(); i++)
+        cached.labels.push_back(h4->get_label_at(i));
+    return cached.next_id;
+}
 
-    hdr->setSrcID(src);
-    hdr->setDstID(dst);
-    hdr->setPreID(src); // this column is not important when the packet is first received by the src (i.e., just generated)
-    hdr->setNexID(src); // this column is not important when the packet is first received by the src (i.e., just generated)
-
-    pld->setMsg(msg);
-
-    pkt->setSize(size);
-
-    // cout << "**size = " << pkt->getSize() << "**" << endl ;
-
-    recv_event::recv_data e_data;
-    e_data.s_id = src;
-    e_data.r_id = src; // to make the packet start from the src
-    e_data._pkt = pkt;
+void TRA_switch::cspf_compute(uint dst_id, double size, TRA_data_header *h, cspf_route &route)
+{
+    uint self = getNodeID();
+    uint n = origins.size();
+    route.path.clear();
+    route.labels.clear();
+    if (dst_id >= n || self >= n)
+        return;
 
-    recv_event *e = dynamic_cast<recv_event *>(event::event_generator::generate("recv_event", trigger_time, (void *)&e_data));
+    // a hop-shortest path over the links with room for the packet
+    vector<uint> pre(n, UINT_MAX);
+    vector<uint> frontier;
+    pre[self] = self;
+    frontier.push_back(self);
+    for (uint f = 0; f < frontier.size() && pre[dst_id] == UINT_MAX; f++)
+    {
+        uint x = frontier[f];
+        if (origins[x].block == link_state_db::NO_BLOCK)
+            continue;
+        for (const link_state_db::adjacency &a : link_state_db::adjacencies(origins[x].block))
+        {
+            uint w = a.nb_id;
+            if (a.capacity <= 0 || double(a.capacity) - double(a.occupied) < size || pre[w] != UINT_MAX) // no room, as in fits()
+                continue;
+            if (h != nullptr && h->visited(w))
+                continue;
+            pre[w] = x;
+            frontier.push_back(w);
+        }
+    }
+    if (pre[dst_id] == UINT_MAX)
+        return;
+    for (uint x = dst_id; x != self; x = pre[x])
+        route.path.push_back(x);
+    route.path.push_back(self);
+    reverse(route.path.begin(), route.path.end());
+
+    // cut it greedily into the longest segments that are unique shortest paths over all the links; a part of a unique
+    // shortest path is one as well, so this takes the fewest labels for the path
+    vector<uint> dist(n), count(n);
+    for (uint i = 0; i + 1 < route.path.size();)
+    {
+        fill(dist.begin(), dist.end(), UINT_MAX);
+        fill(count.begin(), count.end(), 0);
+        frontier.clear();
+        dist[route.path[i]] = 0;
+        count[route.path[i]] = 1;
+        frontier.push_back(route.path[i]);
+        for (uint f = 0; f < frontier.size(); f++)
+        {
+            uint x = frontier[f];
+            if (dist[x] >= route.path.size() - i || origins[x].block == link_state_db::NO_BLOCK)
+                continue;
+            for (const link_state_db::adjacency &a : link_state_db::adjacencies(origins[x].block))
+            {
+                uint w = a.nb_id;
+                if (a.capacity <= 0)
+                    continue;
+                if (dist[w] == UINT_MAX)
+                {
+                    dist[w] = dist[x] + 1;
+                    frontier.push_back(w);
+                }
+                if (dist[w] == dist[x] + 1)
+                    count[w] = min(count[w] + count[x], 2u);
+            }
+        }
+        uint j = i + 1;
+        while (j + 1 < route.path.size() && dist[route.path[j + 1]] == j + 1 - i && count[route.path[j + 1]] == 1)
+            j++;
+        if (j + 1 < route.path.size())
+            route.labels.push_back(route.path[j]);
+        i = j;
+    }
 }
-uint TRA_data_pkt_gen_event::event_priority() const
+
+const TRA_switch::cspf_route *TRA_switch::cspf_find(uint dst_id, double size, TRA_data_header *h)
 {
-    string string_for_hash;
-    string_for_hash = to_string(getTriggerTime()) + to_string(src) + to_string(dst); // to_string (pkt->getPacketID());
-    return get_hash_value(string_for_hash);
+    if (cspf_cache_version != link_state_version)
+    {
+        cspf_cache.clear();
+        cspf_cache_version = link_state_version;
+    }
+    // the routes are cached for sizes rounded up to a power of two
+    uint c = size_class(size);
+    auto cached = cspf_cache.end();
+    if (c < SIZE_CLASSES - 1) // a larger packet has no class and always gets the exact search below
+    {
+        cached = cspf_cache.find({dst_id, c});
+        if (cached == cspf_cache.end())
+        {
+            cached = cspf_cache.insert({{dst_id, c}, cspf_route()}).first;
+            cspf_compute(dst_id, double(1ULL << c), nullptr, cached->second);
+        }
+    }
+    bool usable = cached != cspf_cache.end() && !cached->second.path.empty();
+    for (uint i = 1; usable && i < cached->second.path.size(); i++)
+        usable = !h->visited(cached->second.path[i]);
+    if (usable)
+        return &cached->second;
+
+    // the packet has been to the cached route, or only its exact size fits
+    cspf_compute(dst_id, size, h, cspf_scratch);
+    return cspf_scratch.path.empty() ? nullptr : &cspf_scratch;
 }
-// the TRA_data_pkt_gen_event::print() function is used for log file
-void TRA_data_pkt_gen_event::print() const
+
+bool TRA_switch::cspf_fits(const vector<uint> &labels, TRA_data_header *h)
 {
-    cout << "time " << setw(11) << event::getCurTime()
-         << "        " << setw(11) << " "
-         << "        " << setw(11) << " "
-         << "   srcID" << setw(11) << src
-         << "   dstID" << setw(11) << dst
-         << "        " << setw(11) << " "
-         << "        " << setw(11) << " "
-         << "   TRA_data_packet generating" // << setw(5) << size
-         << endl;
+    // follow the cost model of TRA_data_header::push_label
+    uint used = h->get_used_labels();
+    uint top = h->get_label();
+    for (auto it = labels.rbegin(); it != labels.rend(); it++)
+    {
+        used += (*it == h->getSrcID() || *it == top || h->getNexID() == top) ? 1 : 2;
+        top = *it;
+    }
+    return used <= getNumOfLabel();
 }
 
-class TRA_ctrl_pkt_gen_event : public event
+void TRA_switch::path_cache_totals(unsigned long long &hits, unsigned long long &misses, unsigned long long &invalidations)
 {
-public:
-    class gen_data; // forward declaration
-
-private:
-    TRA_ctrl_pkt_gen_event(TRA_ctrl_pkt_gen_event &) {}
-    TRA_ctrl_pkt_gen_event() {} // we don't allow users to new a recv_event by themselves
-    // this constructor cannot be directly called by users; only by generator
-    uint src; // the src
-    uint dst; // the dst
-    double size;
-    // uint mat;
-    // uint act;
-    // packet *pkt; // the packet
-    string msg;
-    // double per; // percentage
-
-protected:
-    TRA_ctrl_pkt_gen_event(uint _trigger_time, void *data) : event(_trigger_time), src(BROCAST_ID), dst(BROCAST_ID)
+    hits = misses = invalidations = 0;
+    for (uint id : node::getNodeIDs())
     {
-        pkt_gen_data *data_ptr = (pkt_gen_data *)data;
-        src = data_ptr->src_id;
-        dst = data_ptr->dst_id;
-        size = data_ptr->_size;
-        // pkt = data_ptr->_pkt;
-        // mat = data_ptr->mat_id;
-        // act = data_ptr->act_id;
-        msg = data_ptr->msg;
-        // per = data_ptr->per;
+        TRA_switch *s = dynamic_cast<TRA_switch *>(node::id_to_node(id));
+        if (s == nullptr)
+            continue;
+        hits += s->path_cache_hits;
+        misses += s->path_cache_misses;
+        invalidations += s->path_cache_invalidations;
     }
+}
 
-public:
-    virtual ~TRA_ctrl_pkt_gen_event() {}
-    // TRA_ctrl_pkt_gen_event will trigger the packet gen function
-    virtual void trigger();
-
-    uint event_priority() const;
+void TRA_switch::print_path_cache_stats(ostream &os)
+{
+    unsigned long long hits, misses, invalidations;
+    path_cache_totals(hits, misses, invalidations);
+    unsigned long long lookups = hits + misses;
+    os << "path cache: " << lookups << " lookups, " << hits << " hits (" << fixed << setprecision(1)
+       << (lookups ? 100.0 * hits / lookups : 0.0) << "%), " << misses << " misses, " << invalidations << " invalidations" << endl;
+}
 
-    class TRA_ctrl_pkt_gen_event_generator;
-    friend class TRA_ctrl_pkt_gen_event_generator;
-    // TRA_ctrl_pkt_gen_event_generator is derived from event_generator to generate an event
-    class TRA_ctrl_pkt_gen_event_generator : public event_generator
-    {
-        static TRA_ctrl_pkt_gen_event_generator sample;
-        // this constructor is only for sample to register this event type
-        TRA_ctrl_pkt_gen_event_generator() { /*cout << "send_event registered" << endl;*/ register_event_type(&sample); }
+void TRA_switch::table_bytes(map<string, unsigned long long> &bytes) const
+{
+    const unsigned long long node_overhead = 2 * sizeof(void *); // per element of a node-based container, roughly
+    unsigned long long b = origins.capacity() * sizeof(origin_state);
+    for (const origin_state &o : origins)
+        b += o.entries.capacity() * sizeof(uint) + o.more_entry_bits.capacity() * sizeof(unsigned long long);
+    bytes["origins"] += b;
+    bytes["neighbor slots"] += nb_slots.bucket_count() * sizeof(void *) + nb_slots.size() * (sizeof(pair<const uint, uint>) + node_overhead);
+    bytes["forwarding table"] += fib.capacity() * sizeof(fib_entry) + fib_alts.capacity() * sizeof(pair<uint, uint>) + residual.capacity() * sizeof(double);
+    bytes["preset routes"] += preset_routes.capacity() * sizeof(uint);
+    b = source_routes.bucket_count() * sizeof(void *);
+    for (auto &it : source_routes)
+        b += sizeof(it) + node_overhead + it.second.labels.capacity() * sizeof(uint);
+    bytes["source path cache"] += b;
+    b = 0;
+    for (auto &it : cspf_cache)
+        b += sizeof(it) + 2 * node_overhead + (it.second.path.capacity() + it.second.labels.capacity()) * sizeof(uint);
+    bytes["cspf cache"] += b;
+}
 
-    protected:
-        virtual event *generate(uint _trigger_time, void *data)
+bool mem_accounting::report(const string &path)
+{
+    ostringstream os;
+    const char *names[KINDS] = {"header", "payload", "packet", "event", "node", "link"};
+    os << "memory at time " << event::getCurTime() << endl;
+    os << left << setw(20) << "kind" << right << setw(14) << "live objects" << setw(16) << "live bytes" << setw(16) << "peak bytes" << setw(16) << "allocations" << endl;
+    for (uint k = 0; k < KINDS; k++)
+        os << left << setw(20) << names[k] << right << setw(14) << live[k] << setw(16) << bytes[k] << setw(16) << peak[k] << setw(16) << allocations[k] << endl;
+    os << left << setw(20) << "total" << right << setw(14) << "" << setw(16) << total_bytes << setw(16) << total_peak << endl;
+
+    map<string, unsigned long long> tables;
+    for (uint id : node::getNodeIDs())
+        if (TRA_switch *s = dynamic_cast<TRA_switch *>(node::id_to_node(id)))
+            s->table_bytes(tables);
+    tables["link_state_db (shared)"] = link_state_db::getBytes();
+    os << endl
+       << left << setw(34) << "TRA_switch tables" << right << setw(16) << "bytes" << endl;
+    for (auto &it : tables)
+        os << left << setw(34) << it.first << right << setw(16) << it.second << endl;
+
+    // the events still pending hold their packets; any other live packet has leaked
+    map<string, pair<unsigned long long, uint>> pending; // type -> (count, earliest trigger time)
+    unsigned long long held = 0;
+    for (event *e : event::registry)
+        if (e != nullptr)
         {
-            // cout << "send_event generated" << endl;
-            return new TRA_ctrl_pkt_gen_event(_trigger_time, data);
+            auto it = pending.insert({e->type(), {0, UINT_MAX}}).first;
+            it->second.first++;
+            it->second.second = min(it->second.second, e->trigger_time);
+            held += e->held_packets();
         }
-
-    public:
-        virtual string type() { return "TRA_ctrl_pkt_gen_event"; }
-        ~TRA_ctrl_pkt_gen_event_generator() {}
-    };
-    // this class is used to initialize the TRA_ctrl_pkt_gen_event
-    class pkt_gen_data
+    os << endl
+       << left << setw(34) << "pending events" << right << setw(16) << "count" << setw(16) << "earliest" << endl;
+    for (auto &it : pending)
+        os << left << setw(34) << it.first << right << setw(16) << it.second.first << setw(16) << it.second.second << endl;
+    os << left << setw(34) << "cancelled, not yet dropped" << right << setw(16) << event::tombstones << endl;
+    os << endl
+       << "packets held by pending events: " << held << endl
+       << "packets held by nothing (leaked): " << (long long)packet::getLivePacketNum() - (long long)held << endl;
+
+    if (path == "-")
     {
-    public:
-        uint src_id;
-        uint dst_id;
-        double _size;
-        // uint mat_id; // the target of the rule
-        // uint act_id; // the next hop toward the target recorded in the rule
-        string msg;
-        // double per; // the percentage
-        // packet *_pkt;
-    };
+        cerr << os.str();
+        return true;
+    }
+    ofstream out(path);
+    return bool(out << os.str());
+}
 
-    void print() const;
-};
-TRA_ctrl_pkt_gen_event::TRA_ctrl_pkt_gen_event_generator TRA_ctrl_pkt_gen_event::TRA_ctrl_pkt_gen_event_generator::sample;
+void TRA_switch::print_to(ostream &os) const
+{
+    node::print_to(os);
+    for (uint src_id = 0; src_id < origins.size(); src_id++)
+        if (!origins[src_id].entries.empty())
+            os << src_id << ' ' << next_hop(src_id) << endl;
+}
 
-void TRA_ctrl_pkt_gen_event::trigger()
+ostream &operator<<(ostream &os, const node &n)
 {
+    n.print_to(os);
+    return os;
+}
 
-    TRA_ctrl_packet *pkt = dynamic_cast<TRA_ctrl_packet *>(packet::packet_generator::generate("TRA_ctrl_packet"));
-    if (pkt == nullptr)
+bool TRA_switch::accept_lsa(uint src_id, TRA_ctrl_payload *l3)
+{
+    origin_state &o = getOriginState(src_id);
+    bool in_order = o.seq_heard && l3->getSeq() == o.last_seq + 1 && !o.stale;
+    o.seq_heard = true;
+    o.last_seq = l3->getSeq();
+    if (l3->isFull())
     {
-        cerr << "packet type is incorrect" << endl;
-        return;
+        o.stale = false;
+        return true;
     }
-    TRA_ctrl_header *hdr = dynamic_cast<TRA_ctrl_header *>(pkt->getHeader());
-    TRA_ctrl_payload *pld = dynamic_cast<TRA_ctrl_payload *>(pkt->getPayload());
+    if (in_order)
+        return true;
+    o.stale = true; // a gap; wait for the next full LSA
+    return false;
+}
 
-    if (hdr == nullptr)
+bool TRA_switch::isNewPacket(packet *p)
+{
+    uint src = p->getHeader()->getSrcID();
+    uint id = p->getPacketID();
+
+    if (src >= origins.size() || !origins[src].heard)
+        return true;
+    else
     {
-        cerr << "header type is incorrect" << endl;
-        return;
+        if (id > origins[src].last_p_id)
+            return true;
+        else
+            return false;
     }
-    if (pld == nullptr)
-    {
-        cerr << "payload type is incorrect" << endl;
+}
+
+// you have to write the code in recv_handler of TRA_switch
+// each node follows this function to handle the received packet
+void TRA_switch::recv_handler(packet *p)
+{
+    // in this function, you are "not" allowed to use node::id_to_node(id) and id_id_to_link(id1, id2) !!!!!!!!
+    // moreover, you cannot use any static variable or static functions in this function
+
+    // this is a simple example
+    // node 0 broadcasts its message to every node and every node relays the packet "only once"
+    // the variable hi is used to examine whether the packet has been received by this node before
+    // you can remove the variable hi and create your own routing table in class TRA_switch
+    if (p == nullptr)
         return;
-    }
 
-    hdr->setSrcID(src);
-    hdr->setDstID(dst);
-    hdr->setPreID(src);
-    // hdr->setNexID(dst); // in hw3, you should set NexID to src
-    hdr->setNexID(src);
+    if (p->type() == "TRA_ctrl_packet")
+    { // the switch receives a packet from the controller
+        TRA_ctrl_packet *p3 = nullptr;
+        p3 = dynamic_cast<TRA_ctrl_packet *>(p);
+        TRA_ctrl_payload *l3 = nullptr;
+        l3 = dynamic_cast<TRA_ctrl_payload *>(p3->getPayload());
 
-    // payload
-    pld->setMsg(msg);
-    pld->setnid(src); // add this line
-    // pld->setMatID(mat);
-    // pld->setActID(act);
-    // pld->setPer(per);
-    pkt->setSize(size);
+        if (p3->getHeader()->getSrcID() == getNodeID()) // if this packet is sent from this node
+        {
+            uint p_id = p3->getPacketID();
+            origin_state &self = getOriginState(getNodeID());
+            if (self.heard && p_id <= self.last_p_id) // receive packet sent itself
+                return;
 
-    recv_event::recv_data e_data;
-    e_data.s_id = src;
-    // e_data.r_id = dst; // in hw3, you should set r_id it src
-    e_data.r_id = src;
-    e_data._pkt = pkt;
+            // put the node's neighbors' information into the netw_info
+            l3->setnid(getNodeID()); // use this line to set the node ID
+            lsa_seq++;
+            bool full = lsa_refresh == 0 || (lsa_seq - 1) % lsa_refresh == 0;
+            l3->setSeq(lsa_seq);
+            l3->setFull(full);
+            map<uint, bool> nblist = getPhyNeighbors();
+            map<uint, pair<double, double>> updates;
+            for (map<uint, bool>::iterator it = nblist.begin(); it != nblist.end(); it++)
+            {
+                unsigned nb_id = it->first; // nb id
+                pair<double, double> state = {getCapacity(nb_id), getOccupied(nb_id)};
+                pair<double, double> known;
+                if (!full && findLinkState(getNodeID(), nb_id, known) && known == link_state_db::quantize(state))
+                    continue; // a delta LSA only carries the changed adjacencies
+                // use this line to add one more entry (one more neighbor) in the payload
+                l3->addNetwInfo(nb_id, state.first, state.second);
+                updates[nb_id] = state;
+            }
+            learn(getNodeID(), updates);
+            origin_state &own = getOriginState(getNodeID());
+            own.heard = true;
+            own.last_p_id = p_id;
+        }
+        else // if this packet is sent from the other node
+        {
+            // you have to design your data structure in TRA_switch to store the network information extracted from the packet
 
-    recv_event *e = dynamic_cast<recv_event *>(event::event_generator::generate("recv_event", trigger_time, (void *)&e_data));
-}
-uint TRA_ctrl_pkt_gen_event::event_priority() const
-{
-    string string_for_hash;
-    // string_for_hash = to_string(getTriggerTime()) + to_string(src) + to_string(dst) + to_string(mat) + to_string(act); //to_string (pkt->getPacketID());
-    string_for_hash = to_string(getTriggerTime()) + to_string(src) + to_string(dst); // to_string (pkt->getPacketID());
-    return get_hash_value(string_for_hash);
-}
-// the TRA_ctrl_pkt_gen_event::print() function is used for log file
-void TRA_ctrl_pkt_gen_event::print() const
-{
-    cout << "time " << setw(11) << event::getCurTime()
-         << "        " << setw(11) << " "
-         << "        " << setw(11) << " "
-         << "   srcID" << setw(11) << src
-         << "   dstID" << setw(11) << dst
-         << "        " << setw(11) << " "
-         << "        " << setw(11) << " "
-         //  << "   matID"       << setw(11) << mat
-         //  << "   actID"       << setw(11) << act
-         << "   TRA_ctrl_packet generating"
-         << endl;
-}
+            // you have to design a variable in TRA_switch for identifying whether the packet was received before
+            // you can check the pktID to see whether the packet was received before
+            // if the packet was, then don't update the information and don't send the packet again
 
-////////////////////////////////////////////////////////////////////////////////
+            // otherwise, update the node's stored network information from the packet
+            uint src_id = l3->getnid();
+            uint pre_id = p3->getHeader()->getPreID();
+            map<uint, pair<double, double>> src_nbs = l3->getNetwInfo();
 
-class link
-{
-    // all links created in the program
-    static map<pair<uint, uint>, link *> id_id_link_table;
+            origin_state &last_packet = getOriginState(src_id);
+            if (!last_packet.heard) // first packet from src node
+            {
+                add_entry(last_packet, pre_id);
+                last_packet.heard = true;
+                last_packet.last_p_id = p->getPacketID();
+                if (accept_lsa(src_id, l3))
+                    learn(src_id, src_nbs);
+            }
+            else if (p->getPacketID() > last_packet.last_p_id) // new packet, update info
+            {
+                // update data
+                last_packet.last_p_id = p->getPacketID();
+                if (accept_lsa(src_id, l3))
+                    learn(src_id, src_nbs);
+            }
+            else
+            {
+                add_entry(last_packet, pre_id);
+                return; // discard packets received before
+            }
 
-    uint id1; // from
-    uint id2; // to
+            // you can use the following loop to get every link's information
+            // cout << "cur_id = " << getNodeID() << ", src_id = " << src_id << endl;
+            // for (map<uint, pair<double, double>>::iterator it = src_nbs.begin(); it != src_nbs.end(); it++)
+            // {
+            //     cout << "nb_id = " << it->first << ", capacity = " << it->second.first << ", occupied = " << it->second.second << endl;
+            //     do something to update the node's stored network information from the packet
+            // }
+        }
 
-protected:
-    link(link &) {} // this constructor should not be used
-    link() {}       // this constructor should not be used
-    link(uint _id1, uint _id2) : id1(_id1), id2(_id2) { id_id_link_table[pair<uint, uint>(id1, id2)] = this; }
+        // update header
+        p3->getHeader()->setPreID(getNodeID());
+        p3->getHeader()->setNexID(BROCAST_ID);
+        p3->getHeader()->setDstID(BROCAST_ID);
 
-public:
-    virtual ~link()
-    {
-        id_id_link_table.erase(pair<uint, uint>(id1, id2)); // erase the link
+        // l3->increase();
+        send_handler(p3);
+        // unsigned mat = l3->getMatID();
+        // unsigned act = l3->getActID();
+        // string msg = l3->getMsg(); // get the msg
     }
-
-    static link *id_id_to_link(uint _id1, uint _id2)
+    else if (p->type() == "TRA_data_packet")
     {
-        return ((id_id_link_table.find(pair<uint, uint>(_id1, _id2)) != id_id_link_table.end()) ? id_id_link_table[pair<unsigned, unsigned>(_id1, _id2)] : nullptr);
-    }
-
-    virtual uint getLatency() = 0; // you must implement your own latency
+        // the switch receives a packet
+        // cout << "node " << getNodeID() << " send the packet" << endl;
+        TRA_data_packet *p4 = nullptr;
+        p4 = dynamic_cast<TRA_data_packet *>(p);
+        TRA_data_payload *l4 = nullptr;
+        l4 = dynamic_cast<TRA_data_payload *>(p4->getPayload());
 
-    static void del_link(uint _id1, uint _id2)
-    {
-        pair<uint, uint> temp;
-        if (id_id_link_table.find(temp) != id_id_link_table.end())
-            id_id_link_table.erase(temp);
-    }
+        // you have to implement the menchanisms of routing table and segment routing here
 
-    static uint getLinkNum() { return id_id_link_table.size(); }
+        // if the node is the source, then insert the labels here
+        // use void push_label(uint _id) to push each label into the header
+        // i.e., p4->getHeader()->push_label(_id);
 
-    virtual bool canTransmit(map<string, double> args = {}) = 0;
-    virtual void reserve(map<string, double> args = {}) = 0;
+        // otherwise, read the label and route the packet toward the label
+        // use uint get_label() to get the current label
+        // i.e., p4->getHeader()->get_label()
 
-    class link_generator
-    {
-        // lock the copy constructor
-        link_generator(link_generator &) {}
-        // store all possible types of link
-        static map<string, link_generator *> prototypes;
+        // once arriving at the intermediate node:
+        // before removing a label, check whther a label can be removed
+        // use uint get_num_labels()
+        // if so, remove a label from the header
+        // use void pop_label() to remove one label from the header
+        // i.e., p4->getHeader()->pop_label()
 
-    protected:
-        // allow derived class to use it
-        link_generator() {}
-        // after you create a new link type, please register the factory of this link type by this function
-        void register_link_type(link_generator *h) { prototypes[h->type()] = h; }
-        // you have to implement your own generate() to generate your link
-        virtual link *generate(uint _id1, uint _id2, map<string, double> args = {}) = 0;
+        // the following code is a naive way to send the packet sent from 4 to 2 and from 2 to 0
+        // you should not write the code in this way; this is for simplicity to demonstrate how the recv_handler works
+        TRA_data_header *h4 = dynamic_cast<TRA_data_header *>(p4->getHeader());
+        uint src_id = h4->getSrcID();
+        uint dst_id = h4->getDstID();
+        uint pre_id = h4->getPreID();
+        uint cur_id = getNodeID();
 
-    public:
-        // you have to implement your own type() to return your link type
-        virtual string type() = 0;
-        // this function is used to generate any type of link derived
-        static link *generate(string type, uint _id1, uint _id2, map<string, double> args = {})
+        if (n_entry_origins < getNodeNum() - 1 && preset_width == 0) // entry table not prepared
+            return;
+        uint next_id;
+        if (cur_id == dst_id) // packet arrive
+            return;
+        else if (cur_id == src_id) // prepare packet to send
         {
-            if (id_id_link_table.find(pair<uint, uint>(_id1, _id2)) != id_id_link_table.end())
-            {
-                std::cerr << "duplicate link id" << std::endl; // link id is duplicated
-                return nullptr;
-            }
-            else if (BROCAST_ID == _id1 || BROCAST_ID == _id2)
-            {
-                cerr << "BROCAST_ID cannot be used" << endl;
-                return nullptr;
-            }
-            else if (prototypes.find(type) != prototypes.end())
-            { // if this type derived exists
-                link *created_link = prototypes[type]->generate(_id1, _id2, args);
-                return created_link; // generate it!!
-            }
-            std::cerr << "no such link type" << std::endl; // otherwise
-            return nullptr;
+            h4->push_label(dst_id); // dst
+            // cout << "the current top label = " << next << endl;
+            h4->setDstID(dst_id);
+            next_id = route_from_source(h4, route_size(p4));
         }
-        static void print()
+        else
         {
-            cout << "registered link types: " << endl;
-            for (map<string, link::link_generator *>::iterator it = prototypes.begin(); it != prototypes.end(); it++)
-                cout << it->second->type() << endl;
+            if (cur_id == h4->get_label())
+                h4->pop_label();
+            // cout << "the current top label = " << next << endl;
+            next_id = route_data(h4, route_size(p4));
         }
-        virtual ~link_generator() {};
-    };
-};
-map<string, link::link_generator *> link::link_generator::prototypes;
-map<pair<uint, uint>, link *> link::id_id_link_table;
+        if (next_id == UINT_MAX)
+            return;
 
-void node::add_phy_neighbor(uint _id, string link_type, map<string, double> link_args)
-{
-    if (id == _id)
-        return; // if the two nodes are the same...
-    if (id_node_table.find(_id) == id_node_table.end())
-        return; // if this node does not exist
-    if (phy_neighbors.find(_id) != phy_neighbors.end())
-        return; // if this neighbor has been added
-    phy_neighbors[_id] = true;
+        // update header
+        h4->visit(cur_id);
+        h4->setPreID(cur_id);
+        h4->setNexID(next_id);
+        send_handler(p);
+    }
 
-    link::link_generator::generate(link_type, id, _id, link_args);
-}
+    // you should implement the OSPF algorithm in recv_handler
+    // getNodeID() returns the id of the current node
 
-void node::del_phy_neighbor(uint _id)
-{
-    phy_neighbors.erase(_id);
-}
+    // The current node's neighbors are already stored in the following variable
+    // map<uint,bool> node::phy_neighbors
+    // however, this variable is private in the class node
+    // You have to use node::getPhyNeighbors to get the variable
+    // for example, if you want to print all the neighbors of this node
+    // const map<uint,bool> &nblist = getPhyNeighbors();
+    // cout << "node " << getNodeID() << "'s nblist: ";
+    // for (map<uint,bool>::const_iterator it = nblist.begin(); it != nblist.end(); it ++) {
+    //     cout << it->first << ", " ;
+    // }
+    // cout << endl;
 
-class simple_link : public link
-{
-    double capacity = 100; // default capacity is set to 100; please set your link's capacity manually by add_phy_neighbor
-    double occupied = 0;   // default occupied is set to 0
+    // you can use p->getHeader()->setSrcID() or getSrcID()
+    //             p->getHeader()->setDstID() or getDstID()
+    //             p->getHeader()->setPreID() or getPreID()
+    //             p->getHeader()->setNexID() or getNexID() to change or read the packet header
 
-    uint latency = ONE_HOP_DELAY; // default latency
+    // In addition, you can get the packet, header, and payload with the correct type (GR)
+    // in fact, this is downcasting
+    // TRA_data_packet * pkt = dynamic_cast<TRA_data_packet*> (p);
+    // TRA_data_header * hdr = dynamic_cast<TRA_data_header*> (p->getHeader());
+    // TRA_data_payload * pld = dynamic_cast<TRA_data_payload*> (p->getPayload());
 
-protected:
-    simple_link() {}                                        // it should not be used outside the class
-    simple_link(simple_link &) {}                           // it should not be used
-    simple_link(uint _id1, uint _id2) : link(_id1, _id2) {} // this constructor cannot be directly called by users
+    // you can also change the TRA_data_payload setting
+    // pld->setMsg(string): to set the message transmitted to the destination
 
-public:
-    virtual ~simple_link() {}
-    virtual uint getLatency() { return latency; } // you can implement your own latency
+    // Besides, you can use packet::packet_generator::generate() to generate a new packet; note that you should fill the header and payload in the packet
+    // moreover, you can use "packet *p2 = packet::packet_generator::replicate(p)" to make a clone p2 of packet p
+    // note that if the packet is generated or replicated manually, you must delete it by packet::discard() manually before recv_handler finishes
 
-    SET(setCapacity, uint, capacity, _capacity);
-    GET(getCapacity, double, capacity);
-    GET(getOccupied, double, occupied);
+    // "IMPORTANT":
+    // You have to "carefully" fill the correct information (e.g., srcID, dstID, ...) in the packet before you send it
+    // Note that if you want to transmit a packet to only one next node (i.e., unicast), then you fill the ID of a specific node to "nexID" in the header
+    // Otherwise, i.e., you want to broadcasts, then you fill "BROCAST_ID" to "nexID" in the header
+    // after that, you can use send_hander() to transmit the packet
+    // usage: send_handler (p);
 
-    SET(setLatency, uint, latency, _latency);
+    // note that packet p will be discarded (deleted) after recv_handler(); you don't need to manually delete it
+}
 
-    bool canTransmit(map<string, double> args = {})
-    {
-        if (args.find("pkt_size") != args.end())
-            return (occupied + args["pkt_size"] <= capacity);
-        return false;
-    }
-    void reserve(map<string, double> args = {})
-    {
-        if (args.find("pkt_size") != args.end())
-            occupied += args["pkt_size"];
-    }
+// apsp_engine computes the shortest paths (in link latency) between all pairs of switches of the topology offline, on a
+// thread pool: one Dijkstra per destination on sparse topologies and a blocked Floyd-Warshall on dense ones
+class apsp_engine
+{
+    uint n = 0;
+    vector<uint> ids;                     // dense index -> node id
+    vector<vector<pair<uint, uint>>> adj; // dense index -> (neighbor index, latency)
+    vector<uint> dist;                    // dist[x * n + d] is the length of the shortest path from x to d
 
-    class simple_link_generator;
-    friend class simple_link_generator;
-    // simple_link is derived from link_generator to generate a link
-    class simple_link_generator : public link_generator
+    template <typename F>
+    static void parallel_for(uint count, uint num_threads, F f)
     {
-        static simple_link_generator sample;
-        // this constructor is only for sample to register this link type
-        simple_link_generator() { /*cout << "simple_link registered" << endl;*/ register_link_type(&sample); }
-
-    protected:
-        virtual link *generate(uint _id1, uint _id2, map<string, double> args = {})
-        { /*cout << "simple_link generated" << endl;*/
-            simple_link *l = new simple_link(_id1, _id2);
-            if (args.find("capacity") != args.end())
-                l->setCapacity(static_cast<uint>(args["capacity"]));
-            if (args.find("latency") != args.end())
-                l->setLatency(static_cast<uint>(args["latency"]));
-            return l;
-        }
+        atomic<uint> next(0);
+        auto worker = [&]()
+        {
+            for (uint i = next++; i < count; i = next++)
+                f(i);
+        };
+        vector<thread> pool;
+        for (uint i = 1; i < min(max(num_threads, 1u), count); i++)
+            pool.push_back(thread(worker));
+        worker();
+        for (thread &th : pool)
+            th.join();
+    }
 
-    public:
-        virtual string type() { return "simple_link"; }
-        ~simple_link_generator() {}
-    };
+public:
+    static const uint INF = UINT_MAX / 2; // so that INF + INF does not overflow
+    static const uint BLOCK = 64;         // the tile size of the blocked Floyd-Warshall
+
+    apsp_engine(); // takes the topology of the current nodes
+    void solve_dijkstra(uint num_threads);
+    void solve_floyd_warshall(uint num_threads);
+    void solve(uint num_threads);
+    uint getDist(uint x, uint d) const { return dist[x * n + d]; }
+    GET(getNodeNum, uint, n);
+    // the neighbors of x ordered by the length of the shortest path to d through them (ties by id), at most max_hops
+    void next_hops(uint x, uint d, uint max_hops, vector<uint> &hops) const;
+    // the next hop and the alternates of every switch to every other one, for TRA_switch::load_routes
+    bool write(const string &path, uint alternates) const;
+    // a hash of the switches, their links and the link latencies, so a route table is only loaded into its own topology
+    static unsigned long long topology_hash();
 };
+const uint apsp_engine::INF;
+const uint apsp_engine::BLOCK;
 
-simple_link::simple_link_generator simple_link::simple_link_generator::sample;
-
-// the data_packet_event function is used to add an initial event
-void data_packet_event(uint src, uint dst, double f_size, uint t = 0, string msg = "default")
+apsp_engine::apsp_engine()
 {
-    if (node::id_to_node(src) == nullptr || (dst != BROCAST_ID && node::id_to_node(dst) == nullptr))
+    map<uint, uint> idx;
+    for (uint id : node::getNodeIDs())
     {
-        cerr << "src or dst is incorrect" << endl;
-        return;
-        return;
+        idx[id] = ids.size();
+        ids.push_back(id);
     }
+    n = ids.size();
+    adj.resize(n);
+    for (uint x = 0; x < n; x++)
+    {
+        node *nd = node::id_to_node(ids[x]);
+        for (auto it = nd->getPhyNeighbors().begin(); it != nd->getPhyNeighbors().end(); it++)
+        {
+            link *l = nd->getLink(it->first);
+            if (l != nullptr && idx.find(it->first) != idx.end())
+                adj[x].push_back({idx[it->first], l->getLatency()});
+        }
+    }
+}
 
-    TRA_data_pkt_gen_event::pkt_gen_data e_data;
-    e_data.src_id = src;
-    e_data.dst_id = dst;
-    e_data._size = f_size;
-    e_data.msg = msg;
-
-    // recv_event *e = dynamic_cast<recv_event*> ( event::event_generator::generate("recv_event",t, (void *)&e_data) );
-    TRA_data_pkt_gen_event *e = dynamic_cast<TRA_data_pkt_gen_event *>(event::event_generator::generate("TRA_data_pkt_gen_event", t, (void *)&e_data));
-    if (e == nullptr)
-        cerr << "event type is incorrect" << endl;
+void apsp_engine::solve(uint num_threads)
+{
+    // Dijkstra costs about n * e * log n and Floyd-Warshall n^3 with a much tighter loop
+    size_t arcs = 0;
+    for (auto &nbs : adj)
+        arcs += nbs.size();
+    if (arcs * 8 >= size_t(n) * n)
+        solve_floyd_warshall(num_threads);
+    else
+        solve_dijkstra(num_threads);
 }
 
-// the TRA_ctrl_packet_event function is used to add an initial event
+void apsp_engine::solve_dijkstra(uint num_threads)
+{
+    // the distances to d are those from d over the reversed links
+    vector<vector<pair<uint, uint>>> radj(n);
+    for (uint x = 0; x < n; x++)
+        for (auto &e : adj[x])
+            radj[e.first].push_back({x, e.second});
+    dist.assign(size_t(n) * n, INF);
+    parallel_for(n, num_threads, [&](uint d)
+                 {
+        vector<uint> to_d(n, INF);
+        priority_queue<pair<uint, uint>, vector<pair<uint, uint>>, greater<pair<uint, uint>>> pq;
+        to_d[d] = 0;
+        pq.push({0, d});
+        while (!pq.empty())
+        {
+            pair<uint, uint> top = pq.top();
+            pq.pop();
+            if (top.first != to_d[top.second])
+                continue;
+            for (auto &e : radj[top.second])
+                if (top.first + e.second < to_d[e.first])
+                {
+                    to_d[e.first] = top.first + e.second;
+                    pq.push({to_d[e.first], e.first});
+                }
+        }
+        for (uint x = 0; x < n; x++)
+            dist[size_t(x) * n + d] = to_d[x]; });
+}
 
-void TRA_ctrl_packet_event(uint src, uint t = event::getCurTime(),
-                           string msg = "default")
+void apsp_engine::solve_floyd_warshall(uint num_threads)
 {
-    // 1st parameter: the source; the destination that want to broadcast a msg with counter 0 (i.e., match ID)
-    // 2nd parameter: time (optional)
-    // 3rd parameter: msg for debug information (optional)
-    if (node::id_to_node(src) == nullptr)
+    dist.assign(size_t(n) * n, INF);
+    for (uint x = 0; x < n; x++)
     {
-        cerr << "id is incorrect" << endl;
-        return;
+        dist[size_t(x) * n + x] = 0;
+        for (auto &e : adj[x])
+            dist[size_t(x) * n + e.first] = min(dist[size_t(x) * n + e.first], e.second);
     }
 
-    // uint src = con_id;
-    TRA_ctrl_pkt_gen_event::pkt_gen_data e_data;
-    e_data.src_id = src;
-    e_data.dst_id = BROCAST_ID;
-    // e_data.mat_id = mat;
-    // e_data.act_id = act;
-    e_data._size = 0; // we assume ctrl msg size is zero
-    e_data.msg = msg;
-    // e_data.per = per;
-
-    TRA_ctrl_pkt_gen_event *e = dynamic_cast<TRA_ctrl_pkt_gen_event *>(event::event_generator::generate("TRA_ctrl_pkt_gen_event", t, (void *)&e_data));
-    if (e == nullptr)
-        cerr << "event type is incorrect" << endl;
+    // relax the tile (ib, jb) through the nodes of block kb; the inner loop is a plain min over two rows,
+    // which the compiler vectorizes
+    auto relax = [&](uint ib, uint jb, uint kb)
+    {
+        uint i_end = min(n, (ib + 1) * BLOCK), j_end = min(n, (jb + 1) * BLOCK), k_end = min(n, (kb + 1) * BLOCK);
+        for (uint k = kb * BLOCK; k < k_end; k++)
+        {
+            const uint *row_k = &dist[size_t(k) * n];
+            for (uint i = ib * BLOCK; i < i_end; i++)
+            {
+                uint *row_i = &dist[size_t(i) * n];
+                uint d_ik = row_i[k];
+                if (d_ik >= INF)
+                    continue;
+                for (uint j = jb * BLOCK; j < j_end; j++)
+                    row_i[j] = min(row_i[j], d_ik + row_k[j]);
+            }
+        }
+    };
+    uint n_blocks = (n + BLOCK - 1) / BLOCK;
+    for (uint kb = 0; kb < n_blocks; kb++)
+    {
+        // the pivot tile first, then the pivot row and column, then the rest
+        relax(kb, kb, kb);
+        parallel_for(2 * n_blocks, num_threads, [&](uint t)
+                     {
+            uint b = t % n_blocks;
+            if (b == kb)
+                return;
+            if (t < n_blocks)
+                relax(kb, b, kb);
+            else
+                relax(b, kb, kb); });
+        parallel_for(n_blocks, num_threads, [&](uint ib)
+                     {
+            if (ib == kb)
+                return;
+            for (uint jb = 0; jb < n_blocks; jb++)
+                if (jb != kb)
+                    relax(ib, jb, kb); });
+    }
 }
 
-link *node::getLink(uint nb_id)
+void apsp_engine::next_hops(uint x, uint d, uint max_hops, vector<uint> &hops) const
 {
-    return link::id_id_to_link(getNodeID(), nb_id);
+    hops.clear();
+    if (x == d)
+        return;
+    vector<pair<uint, uint>> via; // (length through the neighbor, neighbor id)
+    for (auto &e : adj[x])
+        if (dist[size_t(e.first) * n + d] < INF)
+            via.push_back({e.second + dist[size_t(e.first) * n + d], ids[e.first]});
+    sort(via.begin(), via.end());
+    for (uint i = 0; i < via.size() && i < max_hops; i++)
+        hops.push_back(via[i].second);
 }
 
-// send_handler function is used to transmit packet p based on the information in the header
-// Note that the packet p will not be discard after send_handler ()
-void node::send_handler(packet *p)
+bool apsp_engine::write(const string &path, uint alternates) const
 {
-    packet *_p = packet::packet_generator::replicate(p);
-    send_event::send_data e_data;
-    e_data.s_id = _p->getHeader()->getPreID();
-    e_data.r_id = _p->getHeader()->getNexID();
-    e_data._pkt = _p;
-    send_event *e = dynamic_cast<send_event *>(event::event_generator::generate("send_event", event::getCurTime(), (void *)&e_data));
-    if (e == nullptr)
-        cerr << "event type is incorrect" << endl;
+    snapshot_writer w;
+    w.put_str("TRA_routes");
+    w.put<uint>(2); // format version
+    w.put(topology_hash());
+    w.put(n);
+    w.put(alternates + 1);
+    for (uint id : ids)
+        w.put(id);
+    vector<uint> hops;
+    for (uint x = 0; x < n; x++)
+        for (uint d = 0; d < n; d++)
+        {
+            next_hops(x, d, alternates + 1, hops);
+            for (uint k = 0; k <= alternates; k++)
+                w.put(k < hops.size() ? hops[k] : UINT_MAX);
+        }
+    return w.write_to(path);
 }
 
-void node::send(packet *p)
-{ // this function is called by event; not for the user; you cannot change the send function
-    if (p == nullptr)
-        return;
+unsigned long long apsp_engine::topology_hash()
+{
+    fnv_hash h;
+    for (uint id : node::getNodeIDs())
+    {
+        node *nd = node::id_to_node(id);
+        h.add(id);
+        for (auto it = nd->getPhyNeighbors().begin(); it != nd->getPhyNeighbors().end(); it++)
+        {
+            link *l = nd->getLink(it->first);
+            h.add(it->first);
+            h.add(l != nullptr ? l->getLatency() : UINT_MAX);
+        }
+        h.add(UINT_MAX); // ends the neighbor list
+    }
+    return h.value();
+}
 
-    uint _nexID = p->getHeader()->getNexID();
-    for (map<uint, bool>::iterator it = phy_neighbors.begin(); it != phy_neighbors.end(); it++)
+bool TRA_switch::load_routes(const string &path)
+{
+    snapshot_reader r;
+    if (!r.open(path) || r.get_str() != "TRA_routes" || r.get<uint>() != 2)
     {
-        uint nb_id = it->first; // neighbor id
+        cerr << "cannot read the route table " << path << endl;
+        return false;
+    }
+    unsigned long long hash = r.get<unsigned long long>();
+    uint n = r.get<uint>();
+    uint width = r.get<uint>();
+    vector<uint> ids;
+    for (uint i = 0; i < n && r.ok(); i++)
+        ids.push_back(r.get<uint>());
+    if (!r.ok() || n != getNodeNum() || width == 0 || hash != apsp_engine::topology_hash())
+    {
+        cerr << "the route table " << path << " does not match the topology" << endl;
+        return false;
+    }
+    uint max_id = *max_element(ids.begin(), ids.end());
+    for (uint i = 0; i < n && r.ok(); i++)
+    {
+        TRA_switch *s = dynamic_cast<TRA_switch *>(node::id_to_node(ids[i]));
+        if (s == nullptr)
+        {
+            cerr << "the route table " << path << " has no switch " << ids[i] << endl;
+            return false;
+        }
+        s->preset_width = width;
+        s->preset_routes.assign((max_id + 1) * width, UINT_MAX);
+        for (uint d = 0; d < n; d++)
+            for (uint k = 0; k < width; k++)
+                s->preset_routes[ids[d] * width + k] = r.get<uint>();
+        s->fib_dirty = true;
+    }
+    if (!r.ok())
+        cerr << "the route table " << path << " is truncated" << endl;
+    return r.ok();
+}
 
-        if (nb_id != _nexID && BROCAST_ID != _nexID)
-            continue; // this neighbor will not receive the packet
+// topology_generator writes a whole input (the header, the links and the flows) for a generated topology (--gen-topo)
+//   type=fattree k=<ports>                    k-ary fat-tree of 5k^2/4 switches (no hosts)
+//   type=torus x=<n> y=<n> [z=<n>]            2D or 3D torus
+//   type=waxman n=<switches> alpha=<a> beta=<b>  points in the unit square, P(u, v) = a * exp(-d(u, v) / (b * sqrt(2)))
+//   type=ba n=<switches> m=<links per switch>   Barabasi-Albert preferential attachment
+//   type=jellyfish n=<switches> r=<ports>      random regular graph built like Jellyfish
+// and for all of them capacity=<c> [capacity_max=<c>] pairs=<flows> size=<flow size> label=<n> period=<t> time=<t> seed=<n>
+// the flows are uniform over the switches and sorted by time, so the same lines also work as a --traffic file
+class topology_generator
+{
+    uint n = 0;
+    vector<pair<uint, uint>> links;
+    splitmix64 rng;
+
+    void fattree(uint k);
+    void torus(uint x, uint y, uint z);
+    void waxman(uint _n, double alpha, double beta);
+    void barabasi_albert(uint _n, uint m);
+    void jellyfish(uint _n, uint r);
+    // parse spec into args and generate the links
+    bool make(const string &spec, map<string, double> &args);
 
-        link *l = link::id_id_to_link(id, nb_id);
-        // if ( !l ) continue; // no such a link
+public:
+    bool generate(const string &spec, ostream &os);
+    // create the switches base_id, base_id + 1, ... and their links directly instead
+    bool build(const string &spec, uint base_id);
+    GET(getNodeNum, uint, n);
+};
 
-        double pkt_size = p->getSize();
-        if (!(l->canTransmit({{"pkt_size", pkt_size}})))
-            continue; // if the capacity is insufficient, drop the packet
-        l->reserve({{"pkt_size", pkt_size}});
+bool topology_generator::make(const string &spec, map<string, double> &args)
+{
+    map<string, string> options;
+    parse_options(spec, options);
+    string type = options["type"];
+    options.erase("type");
+    args = {{"k", 4}, {"x", 8}, {"y", 8}, {"z", 1}, {"n", 100}, {"alpha", 0.4}, {"beta", 0.1},
+            {"m", 2}, {"r", 4}, {"capacity", 10}, {"capacity_max", 0}, {"pairs", 0}, {"size", 5},
+            {"label", 5}, {"period", 300}, {"time", 3000}, {"seed", 1}};
+    for (auto &option : options)
+    {
+        char *value_end = nullptr;
+        double v = strtod(option.second.c_str(), &value_end);
+        if (args.find(option.first) == args.end() || option.second.empty() || *value_end != '\0' || v < 0)
+        {
+            cerr << "unknown or invalid topology option " << option.first << "=" << option.second << endl;
+            return false;
+        }
+        args[option.first] = v;
+    }
+    rng = splitmix64((unsigned long long)args["seed"] * 0x9E3779B97F4A7C15ULL);
+    links.clear();
 
-        uint trigger_time = event::getCurTime() + link::id_id_to_link(id, nb_id)->getLatency(); // we simply assume that the delay is fixed
-        // cout << "node " << id << " send to node " << nb_id << endl;
-        recv_event::recv_data e_data;
-        e_data.s_id = id;    // set the sender   (i.e., preID)
-        e_data.r_id = nb_id; // set the receiver (i.e., nexID)
+    if (type == "fattree")
+    {
+        if (uint(args["k"]) < 2 || uint(args["k"]) % 2 != 0)
+        {
+            cerr << "a fat-tree needs an even k" << endl;
+            return false;
+        }
+        fattree(args["k"]);
+    }
+    else if (type == "torus")
+        torus(max(uint(args["x"]), 1u), max(uint(args["y"]), 1u), max(uint(args["z"]), 1u));
+    else if (type == "waxman")
+        waxman(args["n"], args["alpha"], max(args["beta"], 1e-9));
+    else if (type == "ba")
+        barabasi_albert(args["n"], max(uint(args["m"]), 1u));
+    else if (type == "jellyfish")
+        jellyfish(args["n"], args["r"]);
+    else
+    {
+        cerr << "unknown topology type " << type << endl;
+        return false;
+    }
+    return true;
+}
 
-        packet *p2 = packet::packet_generator::replicate(p);
-        e_data._pkt = p2;
+bool topology_generator::build(const string &spec, uint base_id)
+{
+    map<string, double> args;
+    if (!make(spec, args))
+        return false;
+    for (uint i = 0; i < n; i++)
+    {
+        if (node::node_generator::generate("TRA_switch", base_id + i) == nullptr)
+            return false;
+        node::id_to_node(base_id + i)->setNumOfLabel(args["label"]);
+    }
+    uint capacity = args["capacity"];
+    uint capacity_max = max(uint(args["capacity_max"]), capacity);
+    link::reserve(link::getLinkNum() + 2 * links.size());
+    for (auto &l : links)
+    {
+        map<string, double> entry = {{"capacity", double(capacity + rng.below(capacity_max - capacity + 1))}};
+        node::id_to_node(base_id + l.first)->add_phy_neighbor(base_id + l.second, "simple_link", entry);
+        node::id_to_node(base_id + l.second)->add_phy_neighbor(base_id + l.first, "simple_link", entry);
+    }
+    return true;
+}
 
-        recv_event *e = dynamic_cast<recv_event *>(event::event_generator::generate("recv_event", trigger_time, (void *)&e_data)); // send the packet to the neighbor
-        if (e == nullptr)
-            cerr << "event type is incorrect" << endl;
+bool topology_generator::generate(const string &spec, ostream &os)
+{
+    map<string, double> args;
+    if (!make(spec, args))
+        return false;
+    uint pairs = (n >= 2) ? uint(args["pairs"]) : 0;
+    uint time = args["time"];
+    uint capacity = args["capacity"];
+    uint capacity_max = max(uint(args["capacity_max"]), capacity);
+    string buf = to_string(n) + " " + to_string(links.size()) + " " + to_string(pairs) + " " + to_string(uint(args["label"])) +
+                 " " + to_string(uint(args["period"])) + " " + to_string(time) + "\n";
+    // millions of lines are written in large chunks
+    auto flush = [&](bool force)
+    {
+        if (force || buf.size() >= (1u << 20))
+        {
+            os.write(buf.data(), buf.size());
+            buf.clear();
+        }
+    };
+    for (uint i = 0; i < links.size(); i++)
+    {
+        uint c = capacity + rng.below(capacity_max - capacity + 1);
+        buf += to_string(i) + " " + to_string(links[i].first) + " " + to_string(links[i].second) + " " + to_string(c) + "\n";
+        flush(false);
     }
-    packet::discard(p);
+    vector<pair<uint, pair<uint, uint>>> flows(pairs); // (time, (src, dst))
+    for (auto &f : flows)
+    {
+        f.second.first = rng.below(n);
+        f.second.second = (f.second.first + 1 + rng.below(n - 1)) % n;
+        f.first = rng.below(max(time, 1u));
+    }
+    stable_sort(flows.begin(), flows.end(), [](const pair<uint, pair<uint, uint>> &a, const pair<uint, pair<uint, uint>> &b)
+                { return a.first < b.first; });
+    string size = to_string(uint(args["size"]));
+    for (uint i = 0; i < flows.size(); i++)
+    {
+        buf += to_string(i) + " " + to_string(flows[i].second.first) + " " + to_string(flows[i].second.second) + " " + size +
+               " " + to_string(flows[i].first) + "\n";
+        flush(false);
+    }
+    flush(true);
+    return bool(os);
 }
 
-double TRA_switch::getCapacity(uint nb_id)
+void topology_generator::fattree(uint k)
 {
-    simple_link *l = dynamic_cast<simple_link *>(getLink(nb_id));
-    if (l)
-        return l->getCapacity();
-    return 0;
+    // core switches first, then the aggregation and the edge switches pod by pod
+    uint half = k / 2;
+    uint n_core = half * half;
+    n = n_core + k * k;
+    auto agg = [&](uint pod, uint j)
+    { return n_core + pod * half + j; };
+    auto edge = [&](uint pod, uint j)
+    { return n_core + k * half + pod * half + j; };
+    for (uint pod = 0; pod < k; pod++)
+        for (uint j = 0; j < half; j++)
+        {
+            for (uint i = 0; i < half; i++)
+                links.push_back({edge(pod, i), agg(pod, j)});
+            for (uint c = 0; c < half; c++)
+                links.push_back({agg(pod, j), j * half + c});
+        }
 }
-double TRA_switch::getOccupied(uint nb_id)
+
+void topology_generator::torus(uint x, uint y, uint z)
 {
-    simple_link *l = dynamic_cast<simple_link *>(getLink(nb_id));
-    if (l)
-        return l->getOccupied();
-    return 0;
+    n = x * y * z;
+    uint dims[3] = {x, y, z};
+    uint strides[3] = {1, x, x * y};
+    for (uint id = 0; id < n; id++)
+        for (uint d = 0; d < 3; d++)
+        {
+            uint c = id / strides[d] % dims[d];
+            // with 2 switches in a ring, both directions are the same link
+            if (dims[d] == 1 || (dims[d] == 2 && c == 1))
+                continue;
+            links.push_back({id, id - c * strides[d] + (c + 1) % dims[d] * strides[d]});
+        }
 }
 
-void TRA_switch::print_to(ostream &os) const
+void topology_generator::waxman(uint _n, double alpha, double beta)
 {
-    node::print_to(os);
-    for (auto it = entry_table.begin(); it != entry_table.end(); it++)
-        os << it->first << ' ' << it->second[0] << endl;
+    n = _n;
+    vector<double> px(n), py(n);
+    for (uint i = 0; i < n; i++)
+    {
+        px[i] = rng.uniform();
+        py[i] = rng.uniform();
+    }
+    // the pairs further apart than the cutoff are linked with a probability below 1e-9 and are not tried, so only
+    // the neighboring cells of a grid with the cutoff as its cell size are searched
+    double scale = beta * sqrt(2.0);
+    double cutoff = (alpha > 1e-9) ? scale * log(alpha / 1e-9) : 0;
+    uint g = (cutoff > 0) ? max(1u, min(uint(1 / cutoff), uint(sqrt(double(n))) + 1)) : 1;
+    vector<vector<uint>> cells(size_t(g) * g);
+    auto cell_of = [&](uint i)
+    { return pair<uint, uint>(min(uint(px[i] * g), g - 1), min(uint(py[i] * g), g - 1)); };
+    for (uint i = 0; i < n; i++)
+        cells[size_t(cell_of(i).first) * g + cell_of(i).second].push_back(i);
+    for (uint u = 0; u < n; u++)
+    {
+        pair<uint, uint> c = cell_of(u);
+        for (uint cx = (c.first > 0 ? c.first - 1 : 0); cx <= min(c.first + 1, g - 1); cx++)
+            for (uint cy = (c.second > 0 ? c.second - 1 : 0); cy <= min(c.second + 1, g - 1); cy++)
+                for (uint v : cells[size_t(cx) * g + cy])
+                {
+                    if (v <= u)
+                        continue;
+                    double d = hypot(px[u] - px[v], py[u] - py[v]);
+                    if (rng.uniform() <= alpha * exp(-d / scale))
+                        links.push_back({u, v});
+                }
+    }
 }
 
-ostream &operator<<(ostream &os, const node &n)
+void topology_generator::barabasi_albert(uint _n, uint m)
 {
-    n.print_to(os);
-    return os;
+    n = _n;
+    // the first m + 1 switches form a clique; every later one links to m distinct switches picked by their degree
+    uint seed_size = min(n, m + 1);
+    for (uint u = 0; u < seed_size; u++)
+        for (uint v = u + 1; v < seed_size; v++)
+            links.push_back({u, v});
+    vector<uint> ends; // every switch appears once per link it has
+    for (auto &l : links)
+    {
+        ends.push_back(l.first);
+        ends.push_back(l.second);
+    }
+    vector<uint> targets;
+    for (uint u = seed_size; u < n; u++)
+    {
+        targets.clear();
+        while (targets.size() < m)
+        {
+            uint v = ends[rng.below(ends.size())];
+            if (find(targets.begin(), targets.end(), v) == targets.end())
+                targets.push_back(v);
+        }
+        for (uint v : targets)
+        {
+            links.push_back({v, u});
+            ends.push_back(v);
+            ends.push_back(u);
+        }
+    }
 }
 
-bool TRA_switch::isNewPacket(packet *p)
+void topology_generator::jellyfish(uint _n, uint r)
 {
-    uint src = p->getHeader()->getSrcID();
-    uint id = p->getPacketID();
+    n = _n;
+    r = min(r, n > 0 ? n - 1 : 0);
+    unordered_set<unsigned long long> linked;
+    auto key = [](uint u, uint v)
+    { return (unsigned long long)min(u, v) << 32 | max(u, v); };
+    vector<uint> free_ports(n, r);
+    vector<uint> open;          // the switches with free ports
+    vector<uint> open_slot(n);  // where each of them is in open
+    for (uint i = 0; i < n && r > 0; i++)
+    {
+        open_slot[i] = open.size();
+        open.push_back(i);
+    }
+    auto use_port = [&](uint u)
+    {
+        if (--free_ports[u] > 0)
+            return;
+        open[open_slot[u]] = open.back();
+        open_slot[open.back()] = open_slot[u];
+        open.pop_back();
+    };
 
-    auto it = last_p_id_from_node.find(src);
-    if (it == last_p_id_from_node.end())
-        return true;
-    else
+    // link random pairs of switches with free ports until no such pair is left
+    for (uint fails = 0; open.size() >= 2 && fails < 64 + 4 * open.size();)
     {
-        if (id > it->second)
-            return true;
-        else
-            return false;
+        uint u = open[rng.below(open.size())], v = open[rng.below(open.size())];
+        if (u == v || linked.count(key(u, v)))
+        {
+            fails++;
+            continue;
+        }
+        fails = 0;
+        linked.insert(key(u, v));
+        links.push_back({u, v});
+        use_port(u);
+        use_port(v);
+    }
+    // a switch left with two free ports takes them from a random link (x, y), which becomes (u, x) and (u, y)
+    for (uint tries = 0; !open.empty() && tries < 1024 && !links.empty(); tries++)
+    {
+        uint u = open[rng.below(open.size())];
+        if (free_ports[u] < 2)
+        {
+            if (all_of(open.begin(), open.end(), [&](uint w)
+                       { return free_ports[w] < 2; }))
+                break;
+            continue;
+        }
+        uint i = rng.below(links.size());
+        uint x = links[i].first, y = links[i].second;
+        if (x == u || y == u || linked.count(key(u, x)) || linked.count(key(u, y)))
+            continue;
+        linked.erase(key(x, y));
+        links[i] = {u, x};
+        links.push_back({u, y});
+        linked.insert(key(u, x));
+        linked.insert(key(u, y));
+        use_port(u);
+        use_port(u);
     }
 }
 
-// you have to write the code in recv_handler of TRA_switch
-// each node follows this function to handle the received packet
-void TRA_switch::recv_handler(packet *p)
+// compiled_topology is the binary form of an input written by --compile: the header, the links as a CSR adjacency
+// (both directions of every link, the neighbors of each switch in increasing order) and the flows;
+// --topology maps it and creates the links in bulk instead of parsing and checking the text again
+class compiled_topology
 {
-    // in this function, you are "not" allowed to use node::id_to_node(id) and id_id_to_link(id1, id2) !!!!!!!!
-    // moreover, you cannot use any static variable or static functions in this function
+    unsigned long long payload_hash() const;
 
-    // this is a simple example
-    // node 0 broadcasts its message to every node and every node relays the packet "only once"
-    // the variable hi is used to examine whether the packet has been received by this node before
-    // you can remove the variable hi and create your own routing table in class TRA_switch
-    if (p == nullptr)
-        return;
+public:
+    struct flow
+    {
+        uint src, dst;
+        double size;
+        uint time;
+    };
 
-    if (p->type() == "TRA_ctrl_packet")
-    { // the switch receives a packet from the controller
-        TRA_ctrl_packet *p3 = nullptr;
-        p3 = dynamic_cast<TRA_ctrl_packet *>(p);
-        TRA_ctrl_payload *l3 = nullptr;
-        l3 = dynamic_cast<TRA_ctrl_payload *>(p3->getPayload());
+    uint nSwitch = 0, nLink = 0, nPair = 0, nLabel = 0, period = 0, simulate_time = 0;
+    unsigned long long source_hash = 0; // the text input it was compiled from
+    unsigned long long link_hash = 0;   // the links in input order, as part of the warm-start cache key
+    vector<uint> offsets;               // the neighbors of switch u are [offsets[u], offsets[u + 1])
+    vector<uint> neighbors;
+    vector<double> capacities;
+    vector<flow> flows;
+
+    // parse the text input and write it to path
+    static bool compile(input_scanner &in, const string &path);
+    // a file compiled from another input than the one on stdin (if a file is given there) is rejected as stale
+    bool open(const string &path);
+    // create the links between the switches, which must be generated already
+    bool materialize() const;
+};
 
-        if (p3->getHeader()->getSrcID() == getNodeID()) // if this packet is sent from this node
+unsigned long long compiled_topology::payload_hash() const
+{
+    fnv_hash h;
+    h.add(source_hash);
+    h.add(link_hash);
+    for (uint v : {nSwitch, nLink, nPair, nLabel, period, simulate_time})
+        h.add(v);
+    h.add_bytes(offsets.data(), offsets.size() * sizeof(uint));
+    h.add_bytes(neighbors.data(), neighbors.size() * sizeof(uint));
+    h.add_bytes(capacities.data(), capacities.size() * sizeof(double));
+    for (const flow &f : flows)
+    {
+        h.add(f.src);
+        h.add(f.dst);
+        h.add(f.size);
+        h.add(f.time);
+    }
+    return h.value();
+}
+
+bool compiled_topology::compile(input_scanner &in, const string &path)
+{
+    compiled_topology t;
+    fnv_hash source;
+    source.add_bytes(in.data(), in.size());
+    t.source_hash = source.value();
+    in >> t.nSwitch >> t.nLink >> t.nPair >> t.nLabel >> t.period >> t.simulate_time;
+
+    vector<vector<pair<uint, double>>> adj(t.nSwitch);
+    fnv_hash links;
+    for (uint i = 0; i < t.nLink && in.ok(); i++)
+    {
+        uint id, src, dst;
+        double link_capacity;
+        in >> id >> src >> dst >> link_capacity;
+        links.add(src);
+        links.add(dst);
+        links.add(link_capacity);
+        if (in.ok() && (src >= t.nSwitch || dst >= t.nSwitch))
         {
-            uint p_id = p3->getPacketID();
-            auto last_packet = last_p_id_from_node.find(getNodeID());
-            if (last_packet != last_p_id_from_node.end() && p_id <= last_packet->second) // receive packet sent itself
-                return;
+            cerr << "link " << id << " connects a switch that does not exist" << endl;
+            return false;
+        }
+        if (src == dst)
+            continue;
+        adj[src].push_back({dst, link_capacity});
+        adj[dst].push_back({src, link_capacity});
+    }
+    t.link_hash = links.value();
 
-            // put the node's neighbors' information into the netw_info
-            l3->setnid(getNodeID()); // use this line to set the node ID
-            map<uint, bool> nblist = getPhyNeighbors();
-            for (map<uint, bool>::iterator it = nblist.begin(); it != nblist.end(); it++)
+    t.offsets.push_back(0);
+    for (vector<pair<uint, double>> &arcs : adj)
+    {
+        // a repeated link keeps the capacity it was added with first, as add_phy_neighbor does
+        stable_sort(arcs.begin(), arcs.end(), [](const pair<uint, double> &a, const pair<uint, double> &b)
+                    { return a.first < b.first; });
+        for (uint i = 0; i < arcs.size(); i++)
+            if (i == 0 || arcs[i].first != arcs[i - 1].first)
             {
-                unsigned nb_id = it->first; // nb id
-                // use this line to add one more entry (one more neighbor) in the payload
-                l3->addNetwInfo(nb_id, getCapacity(nb_id), getOccupied(nb_id));
-                network[{getNodeID(), nb_id}] = {getCapacity(nb_id), getOccupied(nb_id)};
+                t.neighbors.push_back(arcs[i].first);
+                t.capacities.push_back(arcs[i].second);
             }
-            last_p_id_from_node[getNodeID()] = p_id;
+        t.offsets.push_back(t.neighbors.size());
+        vector<pair<uint, double>>().swap(arcs);
+    }
+
+    t.flows.resize(t.nPair);
+    for (uint i = 0; i < t.nPair && in.ok(); i++)
+    {
+        uint id;
+        in >> id >> t.flows[i].src >> t.flows[i].dst >> t.flows[i].size >> t.flows[i].time;
+    }
+    if (!in.ok())
+    {
+        cerr << "the input is incomplete" << endl;
+        return false;
+    }
+
+    snapshot_writer w;
+    w.put_str("TRA_topology");
+    w.put<uint>(1); // format version
+    w.put(t.source_hash);
+    w.put(t.link_hash);
+    for (uint v : {t.nSwitch, t.nLink, t.nPair, t.nLabel, t.period, t.simulate_time})
+        w.put(v);
+    w.put_array(t.offsets);
+    w.put_array(t.neighbors);
+    w.put_array(t.capacities);
+    for (const flow &f : t.flows)
+    {
+        w.put(f.src);
+        w.put(f.dst);
+        w.put(f.size);
+        w.put(f.time);
+    }
+    w.put(t.payload_hash());
+    if (!w.write_to(path))
+    {
+        cerr << "cannot write the compiled topology " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+bool compiled_topology::open(const string &path)
+{
+    snapshot_reader r;
+    if (!r.open(path) || r.get_str() != "TRA_topology" || r.get<uint>() != 1)
+    {
+        cerr << path << " is not a compiled topology" << endl;
+        return false;
+    }
+    source_hash = r.get<unsigned long long>();
+    link_hash = r.get<unsigned long long>();
+    for (uint *v : {&nSwitch, &nLink, &nPair, &nLabel, &period, &simulate_time})
+        *v = r.get<uint>();
+    r.get_array(offsets, size_t(nSwitch) + 1);
+    bool sorted = r.ok() && offsets[0] == 0 && is_sorted(offsets.begin(), offsets.end());
+    r.get_array(neighbors, sorted ? offsets.back() : 0);
+    r.get_array(capacities, neighbors.size());
+    flows.resize(sorted ? nPair : 0);
+    for (flow &f : flows)
+    {
+        f.src = r.get<uint>();
+        f.dst = r.get<uint>();
+        f.size = r.get<double>();
+        f.time = r.get<uint>();
+    }
+    unsigned long long checksum = r.get<unsigned long long>();
+    if (!sorted || !r.ok() || checksum != payload_hash())
+    {
+        cerr << path << " is truncated or corrupted" << endl;
+        return false;
+    }
+
+    // hashing the text is much cheaper than parsing it, so the check is done whenever the text is at hand
+    struct stat st;
+    if (fstat(fileno(stdin), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        input_scanner in;
+        in.open_stdin();
+        fnv_hash source;
+        source.add_bytes(in.data(), in.size());
+        if (source.value() != source_hash)
+        {
+            cerr << path << " was compiled from another input; please compile it again" << endl;
+            return false;
         }
-        else // if this packet is sent from the other node
+    }
+    return true;
+}
+
+bool compiled_topology::materialize() const
+{
+    link::reserve(neighbors.size());
+    for (uint u = 0; u < nSwitch; u++)
+    {
+        uint n = offsets[u + 1] - offsets[u];
+        node *nd = node::id_to_node(u);
+        if (nd == nullptr)
         {
-            // you have to design your data structure in TRA_switch to store the network information extracted from the packet
+            cerr << "switch " << u << " is not generated" << endl;
+            return false;
+        }
+        nd->add_phy_neighbors(neighbors.data() + offsets[u], n);
+        if (!link::link_generator::generate_all("simple_link", u, neighbors.data() + offsets[u], capacities.data() + offsets[u], n))
+            return false;
+    }
+    return true;
+}
 
-            // you have to design a variable in TRA_switch for identifying whether the packet was received before
-            // you can check the pktID to see whether the packet was received before
-            // if the packet was, then don't update the information and don't send the packet again
+// microbench times the simulator's hot primitives in isolation (--microbench); every case is calibrated to batches of
+// about 5 ms, warmed up and then repeated, and the table gives ns per operation as the mean with its 95% confidence
+// interval, the median and the minimum of the repetitions
+class microbench
+{
+    typedef chrono::steady_clock clock;
+    typedef function<double(uint)> body; // runs n operations and returns the ns spent in the timed part
+
+    static double elapsed_ns(clock::time_point since) { return chrono::duration<double, nano>(clock::now() - since).count(); }
+    static void measure(const string &name, body f, uint repetitions);
+    static void drain();
+    static void reset();
+
+    static double event_queue(uint n, uint queue_size, bool ties);
+    static double compare(uint n);
+    static packet *data_packet(uint src, uint dst);
+    static packet *ctrl_packet(uint src, uint pre);
+    static double replicate(uint n, bool data);
+    static double send(uint n, uint hub);
+    static double recv(uint n, bool data);
 
-            // otherwise, update the node's stored network information from the packet
-            uint src_id = l3->getnid();
-            uint pre_id = p3->getHeader()->getPreID();
-            map<uint, pair<double, double>> src_nbs = l3->getNetwInfo();
+public:
+    // run the cases whose name contains filter
+    static bool run(const string &filter, uint repetitions);
+};
 
-            auto last_packet = last_p_id_from_node.find(src_id);
-            if (last_packet == last_p_id_from_node.end()) // first packet from src node
-            {
-                uint pre_id = p3->getHeader()->getPreID();
-                vector<uint> entries;
-                entries.push_back(pre_id);
-                entry_table.insert({src_id, entries});
-                last_p_id_from_node.insert({src_id, p->getPacketID()});
-                for (auto nb = src_nbs.begin(); nb != src_nbs.end(); nb++)
-                    network.insert({{src_id, nb->first}, {nb->second}});
-            }
-            else if (p->getPacketID() > last_packet->second) // new packet, update info
-            {
-                // update data
-                for (auto nb = src_nbs.begin(); nb != src_nbs.end(); nb++)
-                    network[{src_id, nb->first}] = {nb->second};
-                last_packet->second = p->getPacketID();
-            }
-            else
-            {
-                for (auto it = entry_table.at(src_id).begin(); it != entry_table.at(src_id).end(); it++)
-                    if (*it == pre_id)
-                        return;
-                entry_table.at(src_id).push_back(pre_id);
-                return; // discard packets received before
-            }
+void microbench::measure(const string &name, body f, uint repetitions)
+{
+    uint n = 16;
+    while (f(n) < 5e6 && n < (1u << 24))
+        n *= 2;
+    for (uint i = 0; i < 2; i++) // warmup
+        f(n);
+    vector<double> samples;
+    for (uint i = 0; i < repetitions; i++)
+        samples.push_back(f(n) / n);
+
+    double mean = 0, var = 0;
+    for (double x : samples)
+        mean += x / samples.size();
+    for (double x : samples)
+        var += (x - mean) * (x - mean) / max<size_t>(samples.size() - 1, 1);
+    // the 97.5% quantile of Student's t with samples.size() - 1 degrees of freedom
+    static const double t975[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    size_t df = samples.size() - 1;
+    double t = (df == 0) ? 0 : (df <= 30 ? t975[df - 1] : 1.96);
+    sort(samples.begin(), samples.end());
+    cout << left << setw(28) << name << right << fixed << setprecision(1)
+         << setw(12) << mean << setw(10) << t * sqrt(var / samples.size())
+         << setw(12) << samples[samples.size() / 2] << setw(12) << samples[0]
+         << setw(12) << n << endl;
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+}
 
-            // you can use the following loop to get every link's information
-            // cout << "cur_id = " << getNodeID() << ", src_id = " << src_id << endl;
-            // for (map<uint, pair<double, double>>::iterator it = src_nbs.begin(); it != src_nbs.end(); it++)
-            // {
-            //     cout << "nb_id = " << it->first << ", capacity = " << it->second.first << ", occupied = " << it->second.second << endl;
-            //     do something to update the node's stored network information from the packet
-            // }
-        }
+// delete the events the last case left in the queue, with the packets they hold
+void microbench::drain()
+{
+    while (!event::events.empty())
+        delete event::get_next_event();
+}
 
-        // update header
-        p3->getHeader()->setPreID(getNodeID());
-        p3->getHeader()->setNexID(BROCAST_ID);
-        p3->getHeader()->setDstID(BROCAST_ID);
+// put switch 0 back as the warmup left it, so that every batch of a case runs the same code path: the torus carries
+// no traffic, and the source path and cspf caches start cold
+void microbench::reset()
+{
+    TRA_switch *sw = dynamic_cast<TRA_switch *>(node::id_to_node(0));
+    for (auto &nb : sw->getPhyNeighbors())
+        dynamic_cast<simple_link *>(sw->getLink(nb.first))->occupied = 0;
+    sw->source_routes.clear();
+    sw->cspf_cache.clear();
+}
 
-        // l3->increase();
-        send_handler(p3);
-        // unsigned mat = l3->getMatID();
-        // unsigned act = l3->getActID();
-        // string msg = l3->getMsg(); // get the msg
-    }
-    else if (p->type() == "TRA_data_packet")
+// the hold model: take the next event and put it back later, with a queue of queue_size events; the delays are
+// link latencies (so many events share a time and are ordered by their priorities) or exponential
+double microbench::event_queue(uint n, uint queue_size, bool ties)
+{
+    splitmix64 rng(queue_size);
+    auto delay = [&]()
+    { return ties ? 1 + rng.below(2 * ONE_HOP_DELAY) : 1 + uint(rng.exponential(100)); };
+    for (uint i = 0; i < queue_size; i++)
     {
-        // the switch receives a packet
-        // cout << "node " << getNodeID() << " send the packet" << endl;
-        TRA_data_packet *p4 = nullptr;
-        p4 = dynamic_cast<TRA_data_packet *>(p);
-        TRA_data_payload *l4 = nullptr;
-        l4 = dynamic_cast<TRA_data_payload *>(p4->getPayload());
+        TRA_data_pkt_gen_event::pkt_gen_data d = {i % 64, i * 7 % 64, 1, "bench"};
+        event::event_generator::generate("TRA_data_pkt_gen_event", delay(), (void *)&d);
+    }
+    vector<uint> delays(n);
+    for (uint &d : delays)
+        d = delay();
 
-        // you have to implement the menchanisms of routing table and segment routing here
+    clock::time_point t0 = clock::now();
+    for (uint i = 0; i < n; i++)
+    {
+        event *e = event::get_next_event();
+        e->trigger_time += delays[i];
+        event::add_event(e);
+    }
+    double ns = elapsed_ns(t0);
+    drain();
+    return ns;
+}
 
-        // if the node is the source, then insert the labels here
-        // use void push_label(uint _id) to push each label into the header
-        // i.e., p4->getHeader()->push_label(_id);
+double microbench::compare(uint n)
+{
+    splitmix64 rng(1);
+    vector<event *> pool;
+    for (uint i = 0; i < 1024; i++)
+    {
+        TRA_data_pkt_gen_event::pkt_gen_data d = {i % 64, i * 7 % 64, 1, "bench"};
+        event::event_generator::generate("TRA_data_pkt_gen_event", rng.below(4 * ONE_HOP_DELAY), (void *)&d);
+    }
+    while (!event::events.empty())
+        pool.push_back(event::get_next_event());
+
+    mycomp comp;
+    uint less = 0;
+    clock::time_point t0 = clock::now();
+    for (uint i = 0; i < n; i++)
+        less += comp(pool[i % 1024], pool[(i * 7 + 1) % 1024]);
+    double ns = elapsed_ns(t0);
+    for (event *e : pool)
+        delete e;
+    return ns + (less == UINT_MAX); // keeps the comparisons
+}
 
-        // otherwise, read the label and route the packet toward the label
-        // use uint get_label() to get the current label
-        // i.e., p4->getHeader()->get_label()
+packet *microbench::data_packet(uint src, uint dst)
+{
+    packet *p = packet::packet_generator::generate("TRA_data_packet");
+    p->getHeader()->setSrcID(src);
+    p->getHeader()->setDstID(dst);
+    p->getHeader()->setPreID(src);
+    p->getHeader()->setNexID(src);
+    p->setSize(1);
+    return p;
+}
 
-        // once arriving at the intermediate node:
-        // before removing a label, check whther a label can be removed
-        // use uint get_num_labels()
-        // if so, remove a label from the header
-        // use void pop_label() to remove one label from the header
-        // i.e., p4->getHeader()->pop_label()
+// the LSA of src as it arrives from pre
+packet *microbench::ctrl_packet(uint src, uint pre)
+{
+    packet *p = packet::packet_generator::generate("TRA_ctrl_packet");
+    p->getHeader()->setSrcID(src);
+    p->getHeader()->setDstID(BROCAST_ID);
+    p->getHeader()->setPreID(pre);
+    p->getHeader()->setNexID(BROCAST_ID);
+    TRA_ctrl_payload *l3 = dynamic_cast<TRA_ctrl_payload *>(p->getPayload());
+    l3->setnid(src);
+    for (auto &nb : node::id_to_node(src)->getPhyNeighbors())
+    {
+        simple_link *l = dynamic_cast<simple_link *>(link::id_id_to_link(src, nb.first));
+        l3->addNetwInfo(nb.first, l->getCapacity(), l->getOccupied());
+    }
+    return p;
+}
 
-        // the following code is a naive way to send the packet sent from 4 to 2 and from 2 to 0
-        // you should not write the code in this way; this is for simplicity to demonstrate how the recv_handler works
-        TRA_data_header *h4 = dynamic_cast<TRA_data_header *>(p4->getHeader());
-        uint src_id = h4->getSrcID();
-        uint dst_id = h4->getDstID();
-        uint pre_id = h4->getPreID();
-        uint cur_id = getNodeID();
+double microbench::replicate(uint n, bool data)
+{
+    packet *p = data ? data_packet(0, 9) : ctrl_packet(1, 0);
+    if (data)
+        for (uint label : {1, 2, 3})
+            dynamic_cast<TRA_data_header *>(p->getHeader())->push_label(label);
+    vector<packet *> copies(n);
+    clock::time_point t0 = clock::now();
+    for (uint i = 0; i < n; i++)
+        copies[i] = packet::packet_generator::replicate(p);
+    double ns = elapsed_ns(t0);
+    for (packet *c : copies)
+        packet::discard(c);
+    packet::discard(p);
+    return ns;
+}
 
-        if (entry_table.size() < getNodeNum() - 1) // entry table not prepared
-            return;
-        if (cur_id == dst_id) // packet arrive
-            return;
-        else if (cur_id == src_id) // prepare packet to send
+// broadcast from the hub of a star to all its neighbors, in chunks so that the queued copies stay small;
+// send() takes the packet
+double microbench::send(uint n, uint degree)
+{
+    // the star is built on first use, as it would keep the torus' entry tables from being complete
+    uint hub = 10000 + 1000 * degree;
+    if (node::id_to_node(hub) == nullptr)
+    {
+        for (uint i = 0; i <= degree; i++)
         {
-            h4->push_label(dst_id); // dst
-            // cout << "the current top label = " << next << endl;
-            h4->setDstID(dst_id);
+            node::node_generator::generate("TRA_switch", hub + i);
+            node::id_to_node(hub + i)->setNumOfLabel(5);
+        }
+        for (uint i = 1; i <= degree; i++)
+        {
+            node::id_to_node(hub)->add_phy_neighbor(hub + i, "simple_link", {{"capacity", 100}});
+            node::id_to_node(hub + i)->add_phy_neighbor(hub, "simple_link", {{"capacity", 100}});
         }
-        else if (cur_id == h4->get_label())
-            h4->pop_label();
-        // cout << "the current top label = " << next << endl;
+    }
+    node *nd = node::id_to_node(hub);
+    packet *p = ctrl_packet(hub, hub);
+    double ns = 0;
+    vector<packet *> packets;
+    for (uint done = 0; done < n; done += 256)
+    {
+        packets.clear();
+        for (uint i = done; i < min(n, done + 256); i++)
+            packets.push_back(packet::packet_generator::replicate(p));
+        clock::time_point t0 = clock::now();
+        for (packet *q : packets)
+            nd->send(q);
+        ns += elapsed_ns(t0);
+        drain();
+    }
+    packet::discard(p);
+    return ns;
+}
+
+// switch 0 of the warmed-up torus handles a new LSA of another switch or sends a data packet of its own
+double microbench::recv(uint n, bool data)
+{
+    reset();
+    node *nd = node::id_to_node(0);
+    uint pre = nd->getPhyNeighbors().begin()->first;
+    double ns = 0;
+    vector<packet *> packets;
+    for (uint done = 0; done < n; done += 256)
+    {
+        packets.clear();
+        for (uint i = done; i < min(n, done + 256); i++)
+            packets.push_back(data ? data_packet(0, 1 + i % 63) : ctrl_packet(1 + i % 63, pre));
+        clock::time_point t0 = clock::now();
+        for (packet *p : packets)
+            nd->recv(p);
+        ns += elapsed_ns(t0);
+        drain();
+    }
+    return ns;
+}
+
+bool microbench::run(const string &filter, uint repetitions)
+{
+    // switches 0-63 are a warmed-up 8x8 torus
+    topology_generator torus;
+    if (!torus.build("type=torus,x=8,y=8,capacity=1000000", 0))
+        return false;
+    TRA_switch::fast_forward_control_plane(0, 1);
+
+    vector<pair<string, body>> cases = {
+        {"event_queue/hold-1k-ties", [](uint n)
+         { return event_queue(n, 1000, true); }},
+        {"event_queue/hold-100k-ties", [](uint n)
+         { return event_queue(n, 100000, true); }},
+        {"event_queue/hold-100k-exp", [](uint n)
+         { return event_queue(n, 100000, false); }},
+        {"mycomp/compare", compare},
+        {"replicate/data", [](uint n)
+         { return replicate(n, true); }},
+        {"replicate/ctrl", [](uint n)
+         { return replicate(n, false); }},
+        {"recv_handler/ctrl", [](uint n)
+         { return recv(n, false); }},
+        {"recv_handler/data", [](uint n)
+         { return recv(n, true); }},
+        {"send/fanout-4", [](uint n)
+         { return send(n, 4); }},
+        {"send/fanout-32", [](uint n)
+         { return send(n, 32); }},
+        {"send/fanout-256", [](uint n)
+         { return send(n, 256); }},
+    };
+    cout << left << setw(28) << "case" << right << setw(12) << "ns/op" << setw(10) << "+-95%"
+         << setw(12) << "median" << setw(12) << "min" << setw(12) << "ops/batch" << endl;
+    for (auto &c : cases)
+        if (c.first.find(filter) != string::npos)
+            measure(c.first, c.second, max(repetitions, 2u));
+    return true;
+}
 
-        uint top_id = h4->get_label(); // get top label from the header
-        uint next_id = entry_table.find(top_id)->second[0];
+// the command line options of the simulator; every option is optional
+class sim_options
+{
+public:
+    string checkpoint_file;       // --checkpoint <file> <interval>: write a snapshot every <interval> time units
+    uint checkpoint_interval = 0; //
+    string restore_file;          // --restore <file>: continue the run saved in <file>; the same input must be given
+    string warm_cache_dir;        // --warm-cache <dir>: load/store the converged control plane in <dir>
+    uint warmup = UINT_MAX;       // --warmup <t>: the control plane warms up in [0, t); default is the first flow's time
+    bool fast_forward = false;    // --fast-forward: install the converged control plane directly and simulate data packets only
+    bool spf = false;             // --spf: forward along each switch's shortest-path tree instead of the first flood relay
+    bool cspf = false;            // --cspf: with --spf, steer packets that do not fit their next link with a label stack
+    uint lsa_refresh = 0;         // --delta-lsa <k>: only every k-th LSA is full, the others carry changed adjacencies
+    bool periodic_timers = false; // --periodic-timers: each switch keeps only its next control broadcast queued, in the timer
+                                  // wheel, and simultaneous events are ordered by creation instead of by heap order
+    string apsp_file;             // --apsp <file> [k]: write every switch's next hop and k alternates (default 2) to <file> and exit
+    uint apsp_alternates = 2;     //
+    string routes_file;           // --load-routes <file>: preload the next hops written by --apsp into the switches
+    bool cache_stats = false;     // --cache-stats: print the source path cache counters to stderr at the end
+    string compile_file;          // --compile <file>: write the input on stdin to <file> in binary and exit
+    string topology_file;         // --topology <file>: take the input from <file> written by --compile instead of stdin
+    string traffic_file;          // --traffic <file> [window]: stream more flows from <file>, window (default 1000) time units ahead
+    uint traffic_window = 1000;   //
+    string bench_file;            // --bench <file> [label]: append the phase times, the event rates and the peak RSS as JSON
+    string bench_label;           //
+    string metrics_file;          // --metrics <file> [interval]: write counters and latency histograms as JSON when the simulation
+    uint metrics_interval = 0;    // ends, and sample the event queue depth every <interval> time units
+    string mem_report;            // --mem-report <file>: count the objects by kind and write the live ones when the run ends ("-" for stderr)
+    string profile_file;          // --profile-nodes <file> [top]: write the load of every node to <file> and print the
+    uint profile_top = 20;        // <top> (default 20) nodes by recv_handler time to stderr
+    string golden_file;           // --golden <file>: compare the final routing tables with <file>, or record them if it is missing
+    bool microbench = false;      // --microbench [filter] [repetitions]: time the hot primitives in isolation and exit
+    string microbench_filter;     //
+    uint microbench_reps = 15;    //
+    string gen_topo;              // --gen-topo <key=value,...>: write a generated input to stdout and exit (see topology_generator)
+    string synthetic;             // --synthetic <key=value,...>: generate flows from a traffic model (see traffic_model)
+
+    // whether s is a whole number that fits in a uint
+    static bool is_uint(const char *s)
+    {
+        if (!isdigit((unsigned char)s[0]))
+            return false;
+        char *end;
+        errno = 0;
+        unsigned long v = strtoul(s, &end, 10);
+        return *end == '\0' && errno == 0 && v <= UINT_MAX;
+    }
 
-        pair<double, double> edge = network.at({cur_id, next_id});
-        if (edge.first - edge.second < p4->getSize()) // capacity not enough
+    bool parse(int argc, char *argv[])
+    {
+        for (int i = 1; i < argc; i++)
         {
-            // find another path
-            if (h4->get_used_labels() < getNumOfLabel() - 1) // check #labels
+            string arg = argv[i];
+            // the number following the option, consumed only if it is one
+            auto number = [&](uint &v)
             {
-                // add label
-                vector entries = entry_table.at(dst_id);
-                uint label = entries[0];
-                double capacity;
-                for (uint i = 0; i <= entries.size() / 2; i++)
-                {
-                    auto nb = entries[i];
-                    // find nb with enough capacity
-                    pair nb_edge = network.at({cur_id, nb});
-                    capacity = nb_edge.first - nb_edge.second;
-                    if (!h4->visited(nb) && capacity > p4->getSize())
-                    {
-                        label = nb;
-                        break;
-                    }
-                }
-
-                if (label != entries[0])
+                if (!is_uint(argv[i + 1]))
                 {
-                    h4->push_label(label);
-                    next_id = label;
+                    cerr << "invalid number " << argv[i + 1] << " for option " << arg << endl;
+                    return false;
                 }
+                v = strtoul(argv[++i], nullptr, 10);
+                return true;
+            };
+            if (arg == "--checkpoint" && i + 2 < argc)
+            {
+                checkpoint_file = argv[++i];
+                if (!number(checkpoint_interval))
+                    return false;
+            }
+            else if (arg == "--restore" && i + 1 < argc)
+                restore_file = argv[++i];
+            else if (arg == "--warm-cache" && i + 1 < argc)
+                warm_cache_dir = argv[++i];
+            else if (arg == "--warmup" && i + 1 < argc)
+            {
+                if (!number(warmup))
+                    return false;
+            }
+            else if (arg == "--fast-forward")
+                fast_forward = true;
+            else if (arg == "--spf")
+                spf = true;
+            else if (arg == "--cspf")
+                spf = cspf = true;
+            else if (arg == "--periodic-timers")
+                periodic_timers = true;
+            else if (arg == "--delta-lsa" && i + 1 < argc)
+            {
+                if (!number(lsa_refresh))
+                    return false;
+            }
+            else if (arg == "--apsp" && i + 1 < argc)
+            {
+                apsp_file = argv[++i];
+                if (i + 1 < argc && is_uint(argv[i + 1]))
+                    number(apsp_alternates);
+            }
+            else if (arg == "--load-routes" && i + 1 < argc)
+                routes_file = argv[++i];
+            else if (arg == "--cache-stats")
+                cache_stats = true;
+            else if (arg == "--compile" && i + 1 < argc)
+                compile_file = argv[++i];
+            else if (arg == "--topology" && i + 1 < argc)
+                topology_file = argv[++i];
+            else if (arg == "--bench" && i + 1 < argc)
+            {
+                bench_file = argv[++i];
+                if (i + 1 < argc && argv[i + 1][0] != '-')
+                    bench_label = argv[++i];
+            }
+            else if (arg == "--metrics" && i + 1 < argc)
+            {
+                metrics_file = argv[++i];
+                if (i + 1 < argc && is_uint(argv[i + 1]))
+                    number(metrics_interval);
+            }
+            else if (arg == "--mem-report" && i + 1 < argc)
+                mem_report = argv[++i];
+            else if (arg == "--profile-nodes" && i + 1 < argc)
+            {
+                profile_file = argv[++i];
+                if (i + 1 < argc && is_uint(argv[i + 1]))
+                    number(profile_top);
+            }
+            else if (arg == "--golden" && i + 1 < argc)
+                golden_file = argv[++i];
+            else if (arg == "--microbench")
+            {
+                microbench = true;
+                if (i + 1 < argc && argv[i + 1][0] != '-' && !is_uint(argv[i + 1]))
+                    microbench_filter = argv[++i];
+                if (i + 1 < argc && is_uint(argv[i + 1]))
+                    number(microbench_reps);
+            }
+            else if (arg == "--gen-topo" && i + 1 < argc)
+                gen_topo = argv[++i];
+            else if (arg == "--synthetic" && i + 1 < argc)
+                synthetic = argv[++i];
+            else if (arg == "--traffic" && i + 1 < argc)
+            {
+                traffic_file = argv[++i];
+                if (i + 1 < argc && is_uint(argv[i + 1]))
+                    number(traffic_window);
             }
             else
-                return;
+            {
+                cerr << "unknown or incomplete option " << arg << endl;
+                return false;
+            }
         }
-
-        if (h4->visited(next_id))
-            return;
-
-        // update header
-        h4->visit(cur_id);
-        h4->setPreID(cur_id);
-        h4->setNexID(next_id);
-        send_handler(p);
+        return true;
     }
+};
 
-    // you should implement the OSPF algorithm in recv_handler
-    // getNodeID() returns the id of the current node
-
-    // The current node's neighbors are already stored in the following variable
-    // map<uint,bool> node::phy_neighbors
-    // however, this variable is private in the class node
-    // You have to use node::getPhyNeighbors to get the variable
-    // for example, if you want to print all the neighbors of this node
-    // const map<uint,bool> &nblist = getPhyNeighbors();
-    // cout << "node " << getNodeID() << "'s nblist: ";
-    // for (map<uint,bool>::const_iterator it = nblist.begin(); it != nblist.end(); it ++) {
-    //     cout << it->first << ", " ;
-    // }
-    // cout << endl;
-
-    // you can use p->getHeader()->setSrcID() or getSrcID()
-    //             p->getHeader()->setDstID() or getDstID()
-    //             p->getHeader()->setPreID() or getPreID()
-    //             p->getHeader()->setNexID() or getNexID() to change or read the packet header
-
-    // In addition, you can get the packet, header, and payload with the correct type (GR)
-    // in fact, this is downcasting
-    // TRA_data_packet * pkt = dynamic_cast<TRA_data_packet*> (p);
-    // TRA_data_header * hdr = dynamic_cast<TRA_data_header*> (p->getHeader());
-    // TRA_data_payload * pld = dynamic_cast<TRA_data_payload*> (p->getPayload());
-
-    // you can also change the TRA_data_payload setting
-    // pld->setMsg(string): to set the message transmitted to the destination
-
-    // Besides, you can use packet::packet_generator::generate() to generate a new packet; note that you should fill the header and payload in the packet
-    // moreover, you can use "packet *p2 = packet::packet_generator::replicate(p)" to make a clone p2 of packet p
-    // note that if the packet is generated or replicated manually, you must delete it by packet::discard() manually before recv_handler finishes
-
-    // "IMPORTANT":
-    // You have to "carefully" fill the correct information (e.g., srcID, dstID, ...) in the packet before you send it
-    // Note that if you want to transmit a packet to only one next node (i.e., unicast), then you fill the ID of a specific node to "nexID" in the header
-    // Otherwise, i.e., you want to broadcasts, then you fill "BROCAST_ID" to "nexID" in the header
-    // after that, you can use send_hander() to transmit the packet
-    // usage: send_handler (p);
-
-    // note that packet p will be discarded (deleted) after recv_handler(); you don't need to manually delete it
-}
-
-int main()
+int main(int argc, char *argv[])
 {
+    sim_options opt;
+    if (!opt.parse(argc, argv))
+        return 1;
+    if (!opt.bench_file.empty())
+        bench_stats::enable();
+    if (!opt.mem_report.empty())
+        mem_accounting::enable();
+    if (!opt.profile_file.empty())
+        node_profiler::enable();
+    if (!opt.metrics_file.empty())
+    {
+        sim_metrics::enable(opt.metrics_file, opt.metrics_interval);
+        sim_metrics::add_gauge("live_packets", []()
+                               { return (unsigned long long)packet::getLivePacketNum(); });
+        sim_metrics::add_gauge("path_cache_hits", []()
+                               { unsigned long long h, m, i; TRA_switch::path_cache_totals(h, m, i); return h; });
+        sim_metrics::add_gauge("path_cache_misses", []()
+                               { unsigned long long h, m, i; TRA_switch::path_cache_totals(h, m, i); return m; });
+        sim_metrics::add_gauge("path_cache_invalidations", []()
+                               { unsigned long long h, m, i; TRA_switch::path_cache_totals(h, m, i); return i; });
+    }
+
     // header::header_generator::print();   // print all registered headers
     // payload::payload_generator::print(); // print all registered payloads
     // packet::packet_generator::print();   // print all registered packets
@@ -1952,38 +6936,194 @@ int main()
     // link::link_generator::print();       // print all registered links
     // #define test
     uint nSwitch = 5, nLink, nPair, nLabel, period, simulate_time;
+    if (opt.microbench)
+        return microbench::run(opt.microbench_filter, opt.microbench_reps) ? 0 : 1;
+    if (!opt.gen_topo.empty())
+    {
+        topology_generator generator;
+        return generator.generate(opt.gen_topo, cout) ? 0 : 1;
+    }
 // #define test
 #ifndef test
     {
-        cin >> nSwitch >> nLink >> nPair >> nLabel >> period >> simulate_time;
+        input_scanner in;
+        compiled_topology compiled;
+        bool from_compiled = !opt.topology_file.empty();
+        if (from_compiled)
+        {
+            if (!compiled.open(opt.topology_file))
+                return 1;
+            nSwitch = compiled.nSwitch;
+            nLink = compiled.nLink;
+            nPair = compiled.nPair;
+            nLabel = compiled.nLabel;
+            period = compiled.period;
+            simulate_time = compiled.simulate_time;
+        }
+        else
+        {
+            in.open_stdin();
+            if (!opt.compile_file.empty())
+                return compiled_topology::compile(in, opt.compile_file) ? 0 : 1;
+            in >> nSwitch >> nLink >> nPair >> nLabel >> period >> simulate_time;
+            link::reserve(2 * size_t(nLink));
+        }
+        // with the warm-start cache, the control broadcasts are scheduled after the warmup is known
+        bool warm_start = opt.restore_file.empty() && !opt.warm_cache_dir.empty() && !opt.fast_forward;
+        bool flood = opt.restore_file.empty() && !warm_start && !opt.fast_forward;
+        // the warm start schedules its broadcasts periodically as well; a restored run takes the order from the snapshot
+        event::setStableOrder(opt.periodic_timers || warm_start);
+        // what the converged control plane depends on; the links are added below and the warmup once it is known, while
+        // the flows and the length of the run are left out so that sweeps over them on the same fabric share the cache
+        fnv_hash topology_hash;
+        topology_hash.add(nSwitch);
+        topology_hash.add(nLabel);
+        topology_hash.add(period);
+        topology_hash.add(opt.lsa_refresh);
+        topology_hash.add(opt.spf);
+        topology_hash.add(opt.cspf);
+
         // read the input and generate switch nodes
         for (uint id = 0; id < nSwitch; id++)
         {
             node::node_generator::generate("TRA_switch", id);
             node::id_to_node(id)->setNumOfLabel(nLabel);
-            for (uint time = 0; time <= simulate_time; time += period)
-                TRA_ctrl_packet_event(id, time);
+            dynamic_cast<TRA_switch *>(node::id_to_node(id))->setLSARefresh(opt.lsa_refresh);
+            dynamic_cast<TRA_switch *>(node::id_to_node(id))->setSPFRouting(opt.spf);
+            dynamic_cast<TRA_switch *>(node::id_to_node(id))->setCSPFRouting(opt.cspf);
+            if (flood && opt.periodic_timers) // a restored run gets its pending events from the snapshot
+                TRA_ctrl_packet_periodic_event(id, 0, period, simulate_time);
+            else if (flood)
+                for (uint time = 0; time <= simulate_time; time += period)
+                    TRA_ctrl_packet_event(id, time);
         }
 
         // set switches' neighbors
-        for (uint id = 0; id < nLink; id++)
+        if (from_compiled)
+        {
+            if (!compiled.materialize())
+                return 1;
+            topology_hash.add(compiled.link_hash);
+        }
+        else
         {
-            uint src, dst;
-            double link_capacity;
-            cin >> id >> src >> dst >> link_capacity;
-            map<string, double> entry = {{"capacity", link_capacity}};
-            node::id_to_node(src)->add_phy_neighbor(dst, "simple_link", entry);
-            node::id_to_node(dst)->add_phy_neighbor(src, "simple_link", entry);
+            fnv_hash link_hash; // the same as compiled_topology's, so both inputs share the warm-start cache
+            for (uint id = 0; id < nLink; id++)
+            {
+                uint src, dst;
+                double link_capacity;
+                in >> id >> src >> dst >> link_capacity;
+                link_hash.add(src);
+                link_hash.add(dst);
+                link_hash.add(link_capacity);
+                map<string, double> entry = {{"capacity", link_capacity}};
+                node::id_to_node(src)->add_phy_neighbor(dst, "simple_link", entry);
+                node::id_to_node(dst)->add_phy_neighbor(src, "simple_link", entry);
+            }
+            topology_hash.add(link_hash.value());
         }
 
+        if (!opt.apsp_file.empty())
+        {
+            // the offline tool only needs the topology
+            apsp_engine apsp;
+            apsp.solve(thread::hardware_concurrency());
+            if (!apsp.write(opt.apsp_file, opt.apsp_alternates))
+            {
+                cerr << "cannot write the route table " << opt.apsp_file << endl;
+                return 1;
+            }
+            return 0;
+        }
+        if (!opt.routes_file.empty() && !TRA_switch::load_routes(opt.routes_file))
+            return 1;
+
+        if (opt.fast_forward && opt.restore_file.empty())
+            TRA_switch::fast_forward_control_plane(0, thread::hardware_concurrency());
+
+        if (!opt.traffic_file.empty() && !traffic_source::open(opt.traffic_file, opt.traffic_window))
+            return 1;
+        if (!opt.synthetic.empty() && !traffic_model::configure(opt.synthetic, simulate_time))
+            return 1;
+        uint first_flow_time = min(simulate_time + 1, traffic_source::first_time());
+        if (traffic_model::isConfigured())
+            first_flow_time = min(first_flow_time, traffic_model::getStart());
+        vector<TRA_data_pkt_gen_event::pkt_gen_data> flows;
+        vector<uint> flow_times;
         for (uint id = 0; id < nPair; id++)
         {
             uint src, dst, time;
             double f_size;
-            cin >> id >> src >> dst >> f_size >> time;
-            data_packet_event(src, dst, f_size, time);
+            if (from_compiled)
+            {
+                const compiled_topology::flow &f = compiled.flows[id];
+                src = f.src;
+                dst = f.dst;
+                f_size = f.size;
+                time = f.time;
+            }
+            else
+                in >> id >> src >> dst >> f_size >> time;
+            first_flow_time = min(first_flow_time, time);
+            if (warm_start) // the flows are scheduled after the warmup
+            {
+                flows.push_back({src, dst, f_size, "default"});
+                flow_times.push_back(time);
+            }
+            else if (opt.restore_file.empty())
+                data_packet_event(src, dst, f_size, time);
+        }
+        bench_stats::setDataStart(first_flow_time);
+        if (!warm_start && opt.restore_file.empty())
+        {
+            traffic_source::start();
+            if (traffic_model::isConfigured())
+                traffic_model::start();
+        }
+
+        if (warm_start)
+        {
+            // the converged control plane after [0, warmup) only depends on the fabric, the routing options and the warmup,
+            // so it is cached in a snapshot named by their hash; the flows must not start before the warmup ends
+            uint warmup = min(opt.warmup, first_flow_time);
+            if (opt.warmup != UINT_MAX && warmup < opt.warmup)
+                cerr << "the warmup is cut to " << warmup << " because a flow starts at that time" << endl;
+            topology_hash.add(warmup);
+            topology_hash.add(min(warmup, simulate_time)); // a run shorter than the warmup stops its broadcasts early
+            string cache_file = opt.warm_cache_dir + "/" + topology_hash.hex() + ".lsdb";
+
+            if (snapshot_reader::exists(cache_file))
+            {
+                if (!event::restore(cache_file))
+                    return 1;
+            }
+            else
+            {
+                if (warmup > 0)
+                    for (uint id = 0; id < nSwitch; id++)
+                        TRA_ctrl_packet_periodic_event(id, 0, period, min(warmup - 1, simulate_time));
+                if (warmup > 0)
+                    event::start_simulate(warmup - 1);
+                if (!event::checkpoint(cache_file))
+                    cerr << "cannot write the warm-start cache " << cache_file << endl;
+            }
+
+            for (uint id = 0; id < nSwitch; id++)
+                TRA_ctrl_packet_periodic_event(id, (warmup + period - 1) / period * period, period, simulate_time);
+            for (uint i = 0; i < flows.size(); i++)
+                data_packet_event(flows[i].src_id, flows[i].dst_id, flows[i]._size, flow_times[i]);
+            traffic_source::start();
+            if (traffic_model::isConfigured())
+                traffic_model::start();
         }
+
+        if (!opt.restore_file.empty() && !event::restore(opt.restore_file))
+            return 1;
+        if (opt.checkpoint_interval > 0)
+            event::setCheckpoint(opt.checkpoint_file, opt.checkpoint_interval);
         event::start_simulate(simulate_time);
+        if (opt.cache_stats)
+            TRA_switch::print_path_cache_stats(cerr);
     }
 #endif
 
@@ -2036,8 +7176,41 @@ int main()
     }
 #endif
 
-    for (uint id = 0; id < nSwitch; id++)
-        cout << *(node::id_to_node(id));
+    bench_stats::output_started();
+    string golden = "none";
+    if (opt.golden_file.empty())
+        for (uint id = 0; id < nSwitch; id++)
+            cout << *(node::id_to_node(id));
+    else
+    {
+        ostringstream dump;
+        for (uint id = 0; id < nSwitch; id++)
+            dump << *(node::id_to_node(id));
+        cout << dump.str();
+        if (snapshot_reader::exists(opt.golden_file))
+        {
+            ifstream in(opt.golden_file, ios::binary);
+            golden = (string(istreambuf_iterator<char>(in), istreambuf_iterator<char>()) == dump.str()) ? "match" : "mismatch";
+            if (golden == "mismatch")
+                cerr << "the routing tables differ from " << opt.golden_file << endl;
+        }
+        else
+        {
+            ofstream out(opt.golden_file, ios::binary);
+            if (!(out << dump.str()))
+                cerr << "cannot write the golden file " << opt.golden_file << endl;
+        }
+    }
+    if (!opt.profile_file.empty() && !node_profiler::write(opt.profile_file, opt.profile_top, cerr))
+        cerr << "cannot write the node profile " << opt.profile_file << endl;
+    if (!opt.mem_report.empty() && !mem_accounting::report(opt.mem_report))
+        cerr << "cannot write the memory report " << opt.mem_report << endl;
+    if (!opt.bench_file.empty())
+    {
+        map<string, uint> input = {{"switches", nSwitch}, {"links", nLink}, {"flows", nPair}, {"labels", nLabel}};
+        if (!bench_stats::write(opt.bench_file, opt.bench_label, input, golden))
+            cerr << "cannot write the benchmark report " << opt.bench_file << endl;
+    }
 
-    return 0;
+    return golden == "mismatch" ? 1 : 0;
 }